@@ -0,0 +1,61 @@
+// bench.c
+// Timing and reporting shared by the benchmarks, see bench.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bench.h"
+
+double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void bench_samples_init(bench_samples_t* s, long cap)
+{
+	s->ns = (double*) malloc(cap * sizeof(double));
+	s->n = 0;
+	s->cap = cap;
+}
+
+void bench_sample(bench_samples_t* s, double ns)
+{
+	if (s->n < s->cap)
+		s->ns[s->n++] = ns;
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+
+	return (x > y) - (x < y);
+}
+
+void bench_report(const char* name, bench_samples_t* s, const char* extra)
+{
+	double sum = 0, median = 0, p99 = 0;
+	long i;
+
+	if (s->n > 0) {
+		qsort(s->ns, s->n, sizeof(double), cmp_double);
+		for (i = 0; i < s->n; i++)
+			sum += s->ns[i];
+		median = s->ns[s->n / 2];
+		p99 = s->ns[(s->n * 99) / 100];
+	}
+
+	printf("{\"bench\":\"%s\",\"impl\":\"%s\",\"samples\":%ld,"
+	       "\"median_ns\":%.1f,\"p99_ns\":%.1f,\"ops_per_sec\":%.0f%s%s}\n",
+	       name, BENCH_IMPL, s->n, median, p99,
+	       sum > 0 ? s->n / (sum / 1e9) : 0.0,
+	       extra != NULL ? "," : "", extra != NULL ? extra : "");
+	fflush(stdout);
+
+	free(s->ns);
+	s->ns = NULL;
+	s->n = s->cap = 0;
+}
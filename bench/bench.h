@@ -0,0 +1,71 @@
+/*
+ *  bench.h
+ *  gtthread benchmarks
+ *
+ *  Helpers shared by the benchmarks: a thread API that maps onto gtthread,
+ *  or onto pthread when built with -DBENCH_PTHREAD, a nanosecond clock,
+ *  and the sample set every benchmark reports from.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#ifdef BENCH_PTHREAD
+#include <pthread.h>
+#include <sched.h>
+
+#define BENCH_IMPL "pthread"
+
+typedef pthread_t bench_thread_t;
+typedef pthread_mutex_t bench_mutex_t;
+
+#define bench_init(period)          ((void) (period))
+#define bench_create(t, fn, arg)    pthread_create((t), NULL, (fn), (arg))
+#define bench_join(t, ret)          pthread_join((t), (ret))
+#define bench_yield()               sched_yield()
+#define bench_mutex_init(m)         pthread_mutex_init((m), NULL)
+#define bench_mutex_lock(m)         pthread_mutex_lock(m)
+#define bench_mutex_unlock(m)       pthread_mutex_unlock(m)
+#define bench_mutex_destroy(m)      pthread_mutex_destroy(m)
+#else
+#include <gtthread.h>
+
+#define BENCH_IMPL "gtthread"
+
+typedef gtthread_t bench_thread_t;
+typedef gtthread_mutex_t bench_mutex_t;
+
+#define bench_init(period)          gtthread_init(period)
+#define bench_create(t, fn, arg)    gtthread_create((t), (fn), (arg))
+#define bench_join(t, ret)          gtthread_join((t), (ret))
+#define bench_yield()               gtthread_yield()
+#define bench_mutex_init(m)         gtthread_mutex_init(m)
+#define bench_mutex_lock(m)         gtthread_mutex_lock(m)
+#define bench_mutex_unlock(m)       gtthread_mutex_unlock(m)
+#define bench_mutex_destroy(m)      gtthread_mutex_destroy(m)
+#endif
+
+/* default preemption period for benchmarks that do not measure it */
+#define BENCH_PERIOD 1000
+
+typedef struct {
+	double* ns;     /* one duration per operation or round */
+	long n;
+	long cap;
+} bench_samples_t;
+
+/* Returns a monotonic timestamp in nanoseconds */
+double bench_now(void);
+
+/* Allocates room for cap samples */
+void bench_samples_init(bench_samples_t* s, long cap);
+
+/* Records one sample, dropping it once the set is full */
+void bench_sample(bench_samples_t* s, double ns);
+
+/* Prints one JSON line with the median, p99 and ops/sec of the samples,
+ * where each sample is the cost of one operation. 'extra' is either NULL
+ * or more JSON members, e.g. "\"period_us\":100". Frees the samples. */
+void bench_report(const char* name, bench_samples_t* s, const char* extra);
+
+#endif
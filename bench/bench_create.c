@@ -0,0 +1,67 @@
+// bench_create
+// Thread creation cost: n calls to gtthread_create against one call to
+// gtthread_create_n, for a small and a large fan-out. Each line of output
+// is one JSON object.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <gtthread.h>
+
+static long g_done;
+
+static void* worker(void* arg)
+{
+	g_done++;
+	return NULL;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* lets every created worker run to completion */
+static void drain(long n)
+{
+	while (g_done < n)
+		gtthread_yield();
+	g_done = 0;
+}
+
+static void report(const char* name, long n, double ns)
+{
+	printf("{\"bench\":\"%s\",\"n\":%ld,\"ns_total\":%.0f,"
+	       "\"ns_per_thread\":%.1f,\"threads_per_sec\":%.0f}\n",
+	       name, n, ns, ns / n, n / (ns / 1e9));
+}
+
+static void run(long n)
+{
+	gtthread_t* th = malloc(n * sizeof(gtthread_t));
+	double t0;
+	long i;
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+		gtthread_create(&th[i], worker, NULL);
+	report("create", n, now_ns() - t0);
+	drain(n);
+
+	t0 = now_ns();
+	gtthread_create_n(th, n, worker, NULL, 0);
+	report("create_n", n, now_ns() - t0);
+	drain(n);
+
+	free(th);
+}
+
+int main(int argc, char** argv)
+{
+	gtthread_init(999999);
+	run(100);
+	run(100000);
+	return 0;
+}
@@ -0,0 +1,47 @@
+// bench_create_join
+// Thread lifecycle cost. Latency: each sample creates one thread and
+// joins it. Throughput: each sample creates a wave of threads, joins them
+// all, and counts the cost per thread.
+
+#include <stdio.h>
+#include "bench.h"
+
+#define ROUNDS 10000
+#define WAVES 100
+#define WAVE_SIZE 100
+
+static void* worker(void* arg)
+{
+	return arg;
+}
+
+int main()
+{
+	bench_thread_t th[WAVE_SIZE];
+	bench_samples_t s;
+	double t0;
+	long i, j;
+
+	bench_init(BENCH_PERIOD);
+
+	bench_samples_init(&s, ROUNDS);
+	for (i = 0; i < ROUNDS; i++) {
+		t0 = bench_now();
+		bench_create(&th[0], worker, NULL);
+		bench_join(th[0], NULL);
+		bench_sample(&s, bench_now() - t0);
+	}
+	bench_report("create_join_latency", &s, NULL);
+
+	bench_samples_init(&s, WAVES);
+	for (i = 0; i < WAVES; i++) {
+		t0 = bench_now();
+		for (j = 0; j < WAVE_SIZE; j++)
+			bench_create(&th[j], worker, NULL);
+		for (j = 0; j < WAVE_SIZE; j++)
+			bench_join(th[j], NULL);
+		bench_sample(&s, (bench_now() - t0) / WAVE_SIZE);
+	}
+	bench_report("create_join_throughput", &s, "\"wave\":100");
+	return 0;
+}
@@ -0,0 +1,92 @@
+// bench_handoff
+// Lock handoff between producers and consumers, the test10 pattern
+// scaled up to many pairs. Each producer holds its pair's lock across a
+// yield, so the consumer comes to wait for it, then releases it and
+// yields. The consumers are created first, so in plain round robin a
+// woken consumer would wait for every other thread to have its turn.
+// Each sample is the time from a release to the waiting consumer holding
+// the lock. An optional argument sets the preemption period.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+#define PAIRS 16
+#define ROUNDS 2000
+
+typedef struct {
+	bench_mutex_t mutex;
+	volatile double released;   /* when the producer let go, 0 if taken */
+	long num;
+	bench_samples_t handoffs;   /* under the pair's lock, merged at the end */
+} pair_t;
+
+static pair_t g_pairs[PAIRS];
+static bench_samples_t g_handoffs;
+
+static void* producer(void* arg)
+{
+	pair_t* p = (pair_t*) arg;
+	long i;
+
+	for (i = 0; i < ROUNDS; i++) {
+		bench_mutex_lock(&p->mutex);
+		++p->num;
+		bench_yield();
+		p->released = bench_now();
+		bench_mutex_unlock(&p->mutex);
+		bench_yield();
+	}
+	return NULL;
+}
+
+static void* consumer(void* arg)
+{
+	pair_t* p = (pair_t*) arg;
+	long i;
+
+	for (i = 0; i < ROUNDS; i++) {
+		bench_mutex_lock(&p->mutex);
+		if (p->released != 0) {
+			bench_sample(&p->handoffs, bench_now() - p->released);
+			p->released = 0;
+		}
+		--p->num;
+		bench_mutex_unlock(&p->mutex);
+		bench_yield();
+	}
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	bench_thread_t th[2 * PAIRS];
+	char extra[64];
+	long period = argc > 1 ? atol(argv[1]) : BENCH_PERIOD;
+	long i, j;
+
+	bench_init(period);
+	bench_samples_init(&g_handoffs, PAIRS * ROUNDS);
+
+	for (i = 0; i < PAIRS; i++) {
+		bench_mutex_init(&g_pairs[i].mutex);
+		bench_samples_init(&g_pairs[i].handoffs, ROUNDS);
+		bench_create(&th[i], consumer, &g_pairs[i]);
+	}
+	for (i = 0; i < PAIRS; i++)
+		bench_create(&th[PAIRS + i], producer, &g_pairs[i]);
+	for (i = 0; i < 2 * PAIRS; i++)
+		bench_join(th[i], NULL);
+	for (i = 0; i < PAIRS; i++) {
+		if (g_pairs[i].num != 0)
+			fprintf(stderr, "!ERROR! Pair %ld is off by %ld\n", i, g_pairs[i].num);
+		bench_mutex_destroy(&g_pairs[i].mutex);
+		for (j = 0; j < g_pairs[i].handoffs.n; j++)
+			bench_sample(&g_handoffs, g_pairs[i].handoffs.ns[j]);
+		free(g_pairs[i].handoffs.ns);
+	}
+
+	snprintf(extra, sizeof(extra), "\"pairs\":%d,\"period_us\":%ld", PAIRS, period);
+	bench_report("mutex_handoff", &g_handoffs, extra);
+	return 0;
+}
@@ -0,0 +1,40 @@
+// bench_join_exited
+// Joining a thread that has already terminated. Each sample is the join
+// call alone; the thread is created and run to completion beforehand.
+
+#include <stdio.h>
+#include "bench.h"
+
+#define ROUNDS 10000
+
+static volatile int g_done;
+
+static void* worker(void* arg)
+{
+	g_done = 1;
+	return NULL;
+}
+
+int main()
+{
+	bench_samples_t s;
+	bench_thread_t th;
+	double t0;
+	long i;
+
+	bench_init(BENCH_PERIOD);
+	bench_samples_init(&s, ROUNDS);
+
+	for (i = 0; i < ROUNDS; i++) {
+		g_done = 0;
+		bench_create(&th, worker, NULL);
+		while (!g_done)
+			bench_yield();
+
+		t0 = bench_now();
+		bench_join(th, NULL);
+		bench_sample(&s, bench_now() - t0);
+	}
+	bench_report("join_exited", &s, NULL);
+	return 0;
+}
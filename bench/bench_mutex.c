@@ -0,0 +1,72 @@
+// bench_mutex
+// Mutex cost. Uncontended: each sample is one lock/unlock pair by a single
+// thread. Contended: several threads take the same lock and yield while
+// holding it, so every acquisition has to wait; each sample is the time
+// one lock call took to return. An optional argument sets the preemption
+// period, 0 running cooperatively.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+#define ROUNDS 100000
+#define CONTENDERS 4
+#define CONTENDED_ROUNDS 2000
+
+static bench_mutex_t g_mutex;
+static bench_samples_t g_contended;
+static long g_counter;
+
+static void* contender(void* arg)
+{
+	double t0;
+	long i;
+
+	for (i = 0; i < CONTENDED_ROUNDS; i++) {
+		t0 = bench_now();
+		bench_mutex_lock(&g_mutex);
+		bench_sample(&g_contended, bench_now() - t0);
+		g_counter++;
+		bench_yield();
+		bench_mutex_unlock(&g_mutex);
+		bench_yield();
+	}
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	bench_thread_t th[CONTENDERS];
+	bench_samples_t s;
+	char extra[64];
+	long period = argc > 1 ? atol(argv[1]) : BENCH_PERIOD;
+	double t0;
+	long i;
+
+	bench_init(period);
+	bench_mutex_init(&g_mutex);
+
+	bench_samples_init(&s, ROUNDS);
+	for (i = 0; i < ROUNDS; i++) {
+		t0 = bench_now();
+		bench_mutex_lock(&g_mutex);
+		bench_mutex_unlock(&g_mutex);
+		bench_sample(&s, bench_now() - t0);
+	}
+	snprintf(extra, sizeof(extra), "\"period_us\":%ld", period);
+	bench_report("mutex_uncontended", &s, extra);
+
+	bench_samples_init(&g_contended, CONTENDERS * CONTENDED_ROUNDS);
+	for (i = 0; i < CONTENDERS; i++)
+		bench_create(&th[i], contender, NULL);
+	for (i = 0; i < CONTENDERS; i++)
+		bench_join(th[i], NULL);
+	if (g_counter != CONTENDERS * CONTENDED_ROUNDS)
+		fprintf(stderr, "!ERROR! Lost updates: %ld\n", g_counter);
+	snprintf(extra, sizeof(extra), "\"threads\":%d,\"period_us\":%ld",
+	         CONTENDERS, period);
+	bench_report("mutex_contended", &g_contended, extra);
+
+	bench_mutex_destroy(&g_mutex);
+	return 0;
+}
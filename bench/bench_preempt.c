@@ -0,0 +1,63 @@
+// bench_preempt
+// Preemption overhead. Two threads run the same CPU-bound loop under the
+// preemption period given in microseconds on the command line, 0 meaning
+// no timer. Each sample is the wall time from one finished chunk of the
+// loop to the next, by any thread, reported per iteration; so the samples
+// add up to the run time and switch costs show up in the tail. Compare the
+// ops/sec of a period against that of 0. The pthread build ignores the
+// period and runs under the kernel scheduler.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+#define WORKERS 2
+#define CHUNKS 2000
+#define CHUNK_ITERS 100000
+
+/* g_lock guards the samples and the end of the last chunk, which both
+ * workers update */
+static bench_mutex_t g_lock;
+static bench_samples_t g_chunks;
+static double g_last;
+
+static void* spin(void* arg)
+{
+	volatile unsigned long x = (unsigned long) arg;
+	double now;
+	long i, j;
+
+	for (i = 0; i < CHUNKS; i++) {
+		for (j = 0; j < CHUNK_ITERS; j++)
+			x = x * 6364136223846793005UL + 1442695040888963407UL;
+		bench_mutex_lock(&g_lock);
+		now = bench_now();
+		bench_sample(&g_chunks, (now - g_last) / CHUNK_ITERS);
+		g_last = now;
+		bench_mutex_unlock(&g_lock);
+	}
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	bench_thread_t th[WORKERS];
+	char extra[64];
+	long period = argc > 1 ? atol(argv[1]) : 0;
+	long i;
+
+	bench_init(period);
+	bench_mutex_init(&g_lock);
+	bench_samples_init(&g_chunks, WORKERS * CHUNKS);
+
+	g_last = bench_now();
+	for (i = 0; i < WORKERS; i++)
+		bench_create(&th[i], spin, (void*) (i + 1));
+	for (i = 0; i < WORKERS; i++)
+		bench_join(th[i], NULL);
+	bench_mutex_destroy(&g_lock);
+
+	snprintf(extra, sizeof(extra), "\"period_us\":%ld", period);
+	bench_report("preempt_overhead", &g_chunks, extra);
+	return 0;
+}
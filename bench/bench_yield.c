@@ -0,0 +1,45 @@
+// bench_yield
+// Yield ping-pong between the main thread and one worker. Each sample is
+// one round trip: main yields, the worker runs and yields back. An
+// optional argument sets the preemption period, 0 running cooperatively.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+#define ROUNDS 100000
+
+static volatile int g_stop;
+
+static void* partner(void* arg)
+{
+	while (!g_stop)
+		bench_yield();
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	bench_samples_t s;
+	bench_thread_t th;
+	char extra[64];
+	long period = argc > 1 ? atol(argv[1]) : BENCH_PERIOD;
+	double t0;
+	long i;
+
+	bench_init(period);
+	bench_samples_init(&s, ROUNDS);
+
+	bench_create(&th, partner, NULL);
+	for (i = 0; i < ROUNDS; i++) {
+		t0 = bench_now();
+		bench_yield();
+		bench_sample(&s, bench_now() - t0);
+	}
+	g_stop = 1;
+	bench_join(th, NULL);
+
+	snprintf(extra, sizeof(extra), "\"period_us\":%ld", period);
+	bench_report("yield_pingpong", &s, extra);
+	return 0;
+}
@@ -0,0 +1,91 @@
+// bench_yield_to
+// RPC-style handoff between a client, the main thread, and a server
+// thread, with 8 other threads yielding in the ready queue. Each sample
+// is one call: the client posts a request and switches away until the
+// server has answered it. The calls are made once going round the queue
+// with gtthread_yield and once switching straight to the other side with
+// gtthread_yield_to. An optional argument sets the preemption period, 0
+// running cooperatively. There is no pthread build.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gtthread.h>
+#include "bench.h"
+
+#define ROUNDS 100000
+#define BYSTANDERS 8
+
+static volatile long g_request;
+static volatile long g_response;
+static volatile int g_stop;
+static int g_directed;
+static gtthread_t g_client;
+
+static void* bystander(void* arg)
+{
+	while (!g_stop)
+		gtthread_yield();
+	return NULL;
+}
+
+static void* server(void* arg)
+{
+	while (!g_stop) {
+		g_response = g_request;
+		if (g_directed)
+			gtthread_yield_to(g_client);
+		else
+			gtthread_yield();
+	}
+	return NULL;
+}
+
+static void run(const char* name, int directed, long period)
+{
+	bench_samples_t s;
+	gtthread_t others[BYSTANDERS], th;
+	char extra[64];
+	double t0;
+	long i;
+
+	g_directed = directed;
+	g_stop = 0;
+	g_request = g_response = 0;
+	bench_samples_init(&s, ROUNDS);
+
+	gtthread_create(&th, server, NULL);
+	for (i = 0; i < BYSTANDERS; i++)
+		gtthread_create(&others[i], bystander, NULL);
+	gtthread_yield();
+
+	for (i = 1; i <= ROUNDS; i++) {
+		t0 = bench_now();
+		g_request = i;
+		while (g_response != i) {
+			if (directed)
+				gtthread_yield_to(th);
+			else
+				gtthread_yield();
+		}
+		bench_sample(&s, bench_now() - t0);
+	}
+	g_stop = 1;
+	gtthread_join(th, NULL);
+	for (i = 0; i < BYSTANDERS; i++)
+		gtthread_join(others[i], NULL);
+
+	snprintf(extra, sizeof(extra), "\"bystanders\":%d,\"period_us\":%ld",
+	         BYSTANDERS, period);
+	bench_report(name, &s, extra);
+}
+
+int main(int argc, char** argv)
+{
+	long period = argc > 1 ? atol(argv[1]) : BENCH_PERIOD;
+
+	gtthread_init(period);
+	g_client = gtthread_self();
+	run("rpc_yield", 0, period);
+	run("rpc_yield_to", 1, period);
+	return 0;
+}
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Measures what preemption costs the switches themselves. The yield and
+# mutex benchmarks run against the default build with a 1ms quantum and
+# cooperatively (period 0, no handler and no masking), then against a
+# build with GTTHREAD_COOPERATIVE, after checking that its hot paths make
+# no sigprocmask calls and that the test suite passes on it. The library
+# is left in the default configuration. Run from bench/.
+
+SRC=../src
+HOT="sigvtalrm_handler thread_schedule gtthread_yield gtthread_mutex_lock gtthread_mutex_unlock"
+
+build() {
+	make -s -C $SRC clean >/dev/null 2>&1
+	make -s -C $SRC CONFIG="$1" >/dev/null 2>&1 || { echo "build failed: $1"; exit 1; }
+	make -s clean
+	make -s bench_yield bench_mutex >/dev/null 2>&1 || { echo "bench build failed"; exit 1; }
+}
+
+# the disassembly of one function, with relocations, from the objects
+disasm() {
+	objdump -dr $SRC/gtthread_sched.o $SRC/gtthread_mutex.o \
+		| awk -v f="<$1>:" '$2 == f { on = 1; next } /^$/ { on = 0 } on'
+}
+
+bench() {
+	for b in ./bench_yield ./bench_mutex; do
+		$b $2 | sed "s/}\$/,\"config\":\"$1\"}/"
+	done
+}
+
+rc=0
+build ""
+bench preemptive 1000
+bench cooperative 0
+
+build "-DGTTHREAD_COOPERATIVE=1"
+for f in $HOT; do
+	if [ -z "$(disasm $f)" ]; then
+		echo "!ERROR! $f not found"; rc=1
+	elif disasm $f | grep -q "sigprocmask"; then
+		echo "!ERROR! $f masks signals in the cooperative build"; rc=1
+	fi
+done
+[ $rc -eq 0 ] && echo "cooperative build: no signal masking in $HOT"
+
+# the suite leaves out the tests that need ticks, see src/Makefile
+log=$(mktemp)
+if ! make -C $SRC CONFIG="-DGTTHREAD_COOPERATIVE=1" testall >$log 2>&1 \
+	|| grep -q "ERROR" $log; then
+	grep "ERROR" $log
+	echo "!ERROR! test suite failed in the cooperative build, see $log"; rc=1
+else
+	echo "cooperative build: test suite passed"
+	rm -f $log
+fi
+bench cooperative-build 0
+
+build ""
+exit $rc
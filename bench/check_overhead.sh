@@ -0,0 +1,46 @@
+#!/bin/sh
+# Checks that the default build carries no instrumentation in the hot
+# paths, then compares the yield and mutex benchmarks against a build with
+# every GTTHREAD_ENABLE_* switch on. The library is left in the default
+# configuration. Run from bench/.
+
+SRC=../src
+HOT="sigvtalrm_handler thread_schedule gtthread_yield gtthread_mutex_lock gtthread_mutex_unlock"
+ALL="-DGTTHREAD_ENABLE_STATS=1 -DGTTHREAD_ENABLE_TRACE=1 -DGTTHREAD_ENABLE_LOCKPROF=1 -DGTTHREAD_ENABLE_LATENCY=1 -DGTTHREAD_ENABLE_TICKSTATS=1"
+
+build() {
+	make -s -C $SRC clean >/dev/null 2>&1
+	make -s -C $SRC CONFIG="$1" >/dev/null 2>&1 || { echo "build failed: $1"; exit 1; }
+	make -s clean
+	make -s bench_yield bench_mutex >/dev/null 2>&1 || { echo "bench build failed"; exit 1; }
+}
+
+# the disassembly of one function, with relocations, from the objects
+disasm() {
+	objdump -dr $SRC/gtthread_sched.o $SRC/gtthread_mutex.o \
+		| awk -v f="<$1>:" '$2 == f { on = 1; next } /^$/ { on = 0 } on'
+}
+
+bench() {
+	for b in ./bench_yield ./bench_mutex; do
+		$b | sed "s/}\$/,\"config\":\"$1\"}/"
+	done
+}
+
+rc=0
+build ""
+for f in $HOT; do
+	if [ -z "$(disasm $f)" ]; then
+		echo "!ERROR! $f not found"; rc=1
+	elif disasm $f | grep -E -q "rdtsc|trace_|lockprof_|latency_|ticks_|thread_account|prof_record"; then
+		echo "!ERROR! $f is instrumented in the default build"; rc=1
+	fi
+done
+[ $rc -eq 0 ] && echo "default build: no instrumentation in $HOT"
+bench default
+
+build "$ALL"
+bench instrumented
+
+build ""
+exit $rc
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Compares the context switch of gtthread_switch.c with swapcontext: the
+# yield and mutex benchmarks run against a build with GTTHREAD_UCONTEXT
+# and the default one, with a 1ms quantum and cooperatively. The CPU's
+# vector extensions are printed first, since swapcontext's cost depends
+# on what it saves. The library is left in the default configuration.
+# Run from bench/.
+
+SRC=../src
+
+build() {
+	make -s -C $SRC clean >/dev/null 2>&1
+	make -s -C $SRC CONFIG="$1" >/dev/null 2>&1 || { echo "build failed: $1"; exit 1; }
+	make -s clean
+	make -s bench_yield bench_mutex >/dev/null 2>&1 || { echo "bench build failed"; exit 1; }
+}
+
+bench() {
+	for p in 1000 0; do
+		for b in ./bench_yield ./bench_mutex; do
+			$b $p | sed "s/}\$/,\"config\":\"$1\"}/"
+		done
+	done
+}
+
+echo "cpu: $(grep -o -w -E 'avx|avx2|avx512f' /proc/cpuinfo 2>/dev/null | sort -u | tr '\n' ' ')"
+build "-DGTTHREAD_UCONTEXT=1"
+bench swapcontext
+build ""
+bench switch
@@ -0,0 +1,51 @@
+/*
+ *  gtthread_trace.h
+ *  gtthread
+ *
+ *  Layout of the trace file written by gtthread_trace_start. The file is
+ *  a header followed by a ring of fixed-size events; once the ring is
+ *  full the oldest events are overwritten. Event i of the run lives in
+ *  slot i % capacity and 'head' counts the events recorded so far, so the
+ *  file can be read back even if the program never stopped the trace.
+ */
+
+#ifndef __GTTHREAD_TRACE_H
+#define __GTTHREAD_TRACE_H
+
+#include <stdint.h>
+
+#define GTTHREAD_TRACE_MAGIC "GTTRACE1"
+
+/* event types; 'tid' is the thread the event happened on */
+#define GTTHREAD_TRACE_CREATE 1     /* arg: ID of the new thread */
+#define GTTHREAD_TRACE_EXIT 2       /* arg: final state, 2 done, 1 cancelled */
+#define GTTHREAD_TRACE_SWITCH 3     /* arg: ID of the thread switched to */
+#define GTTHREAD_TRACE_PREEMPT 4    /* a tick arrived; arg unused */
+#define GTTHREAD_TRACE_YIELD 5      /* arg: ID of the thread yielded to, or 0 */
+#define GTTHREAD_TRACE_LOCK_WAIT 6  /* arg: mutex address, the lock was taken */
+#define GTTHREAD_TRACE_LOCK 7       /* arg: mutex address, now owned */
+#define GTTHREAD_TRACE_UNLOCK 8     /* arg: mutex address */
+#define GTTHREAD_TRACE_WAKEUP 9     /* arg: ID of the waiter given the lock */
+#define GTTHREAD_TRACE_JOIN_WAIT 10 /* arg: ID of the thread waited for */
+#define GTTHREAD_TRACE_JOIN 11      /* arg: ID of the thread joined */
+
+typedef struct
+{
+    uint64_t time;  /* timestamp counter, see ticks_per_us */
+    uint64_t arg;
+    uint32_t tid;
+    uint32_t type;
+} gtthread_trace_event_t;
+
+typedef struct
+{
+    char magic[8];          /* GTTHREAD_TRACE_MAGIC, no terminator */
+    uint32_t event_size;    /* sizeof(gtthread_trace_event_t) */
+    uint32_t pad;
+    uint64_t capacity;      /* slots in the ring, a power of two */
+    uint64_t head;          /* events recorded so far */
+    uint64_t start;         /* timestamp when tracing started */
+    double ticks_per_us;    /* timestamp rate */
+} gtthread_trace_header_t;
+
+#endif // __GTTHREAD_TRACE_H
@@ -9,6 +9,7 @@
 #ifndef __GTTHREAD_H
 #define __GTTHREAD_H
 
+#include <stddef.h>
 #include <ucontext.h>
 #include "steque.h"
 
@@ -16,9 +17,23 @@ typedef unsigned long int gtthread_t;
 
 typedef steque_t gtthread_mutex_t; 
 
+/* status reported by gtthread_join for a cancelled thread */
+#define GTTHREAD_CANCELED ((void*) 1)
+
+/* cancel states and types, see gtthread_setcancelstate/_setcanceltype */
+#define GTTHREAD_CANCEL_ENABLE 0
+#define GTTHREAD_CANCEL_DISABLE 1
+#define GTTHREAD_CANCEL_ASYNCHRONOUS 0
+#define GTTHREAD_CANCEL_DEFERRED 1
+
 /* must be called before any of the below functions. failure to do so may
  * result in undefined behavior. 'period' is the scheduling quantum (interval)
- * in microseconds (i.e., 1/1000000 sec.). */
+ * in microseconds (i.e., 1/1000000 sec.). A period of 0 runs the threads
+ * cooperatively: no timer and no SIGVTALRM handler, and the scheduler does
+ * not mask signals, until gtthread_set_quantum, gtthread_adapt_quantum or
+ * gtthread_dump_on_signal asks for them. A library built with
+ * GTTHREAD_COOPERATIVE always runs this way, and those three fail with
+ * ENOSYS. */
 void gtthread_init(long period);
 
 /* see man pthread_create(3); the attr parameter is omitted, and this should
@@ -27,6 +42,14 @@ int  gtthread_create(gtthread_t *thread,
                      void *(*start_routine)(void *),
                      void *arg);
 
+/* creates n threads running start_routine, storing their IDs in
+ * handles[0..n-1]; thread i is passed (char *) args + i * stride. This is
+ * cheaper than n calls to gtthread_create for large fan-outs. Fails with
+ * EINVAL if n is negative or too large to allocate the batch for */
+int  gtthread_create_n(gtthread_t *handles, long n,
+                       void *(*start_routine)(void *),
+                       void *args, size_t stride);
+
 /* see man pthread_join(3) */
 int  gtthread_join(gtthread_t thread, void **status);
 
@@ -39,16 +62,254 @@ void gtthread_exit(void *retval);
 /* see man sched_yield(2) */
 int gtthread_yield(void);
 
+/* like gtthread_yield, but runs the given thread next if it is ready to
+ * run, without going round the ready queue; for handing work straight to
+ * the thread that serves it. A thread still waiting on a mutex or join is
+ * not ready, and the call then yields as usual. Returns -1 with errno
+ * ESRCH if there is no such live thread */
+int gtthread_yield_to(gtthread_t thread);
+
+/* a group of threads sharing the CPU, e.g. those of one tenant */
+typedef struct Group_t* gtthread_group_t;
+
+/* the weight of the threads in no group */
+#define GTTHREAD_GROUP_WEIGHT 100
+
+/* creates a group whose threads together get CPU time in proportion to
+ * weight, against the other groups and the threads in none; the
+ * scheduler picks a group first and one of its threads second, so a
+ * group's share does not grow with its number of threads. A cap other
+ * than 0 is the most the group may use, in percent of the CPU, as a
+ * budget per GTTHREAD_BUDGET_PERIOD like those of gtthread_set_cpu_budget;
+ * the process sleeps rather than run it past that.
+ * Returns -1 for a weight of 0 or a cap over 100 */
+int  gtthread_group_create(gtthread_group_t *group, unsigned long weight, int cap);
+
+/* moves a live thread into group, or out of any if group is NULL; the
+ * threads it creates from then on start in the same group. Returns -1
+ * if there is no such live thread */
+int  gtthread_group_attach(gtthread_group_t group, gtthread_t thread);
+
+/* frees a group that no live thread is in; returns -1 with errno EBUSY
+ * otherwise, or EINVAL for NULL, the default group or a destroyed one */
+int  gtthread_group_destroy(gtthread_group_t group);
+
+/* the period CPU budgets are given per, in nanoseconds */
+#define GTTHREAD_BUDGET_PERIOD 100000000
+
+/* limits a live thread to ns nanoseconds of CPU per GTTHREAD_BUDGET_PERIOD,
+ * e.g. GTTHREAD_BUDGET_PERIOD / 5 for 20% of the CPU, or lifts the limit
+ * if ns is 0. The time a thread runs is charged whenever it switches away
+ * or takes a tick, and one that has used up its budget is parked until
+ * enough of it has come back; the process sleeps if nothing else can run.
+ * Returns -1 with errno EINVAL if ns is negative or more than the period,
+ * ESRCH if there is no such live thread */
+int  gtthread_set_cpu_budget(gtthread_t thread, long ns);
+
+/* how often a thread that had waited far longer than round robin would
+ * have made it, behind threads woken by a mutex or yielded to, was run
+ * ahead of them */
+unsigned long gtthread_starvations(void);
+
 /* see man pthread_equal(3) */
 int  gtthread_equal(gtthread_t t1, gtthread_t t2);
 
-/* see man pthread_cancel(3); but deferred cancelation does not need to be
- * implemented; all threads are canceled immediately */
+/* see man pthread_cancel(3); the target terminates itself, running its
+ * cleanup handlers first. By default threads are canceled deferred, i.e.
+ * only at a cancellation point: gtthread_join, a gtthread_mutex_lock that
+ * has to wait, and gtthread_testcancel; an asynchronous thread is also
+ * canceled whenever it gives up the CPU itself, but never from a tick */
 int  gtthread_cancel(gtthread_t thread);
 
+/* see man pthread_setcancelstate(3) and pthread_setcanceltype(3) */
+int  gtthread_setcancelstate(int state, int *oldstate);
+int  gtthread_setcanceltype(int type, int *oldtype);
+
+/* see man pthread_testcancel(3) */
+void gtthread_testcancel(void);
+
+/* see man pthread_cleanup_push(3); these are functions rather than macros,
+ * but each push should still be matched by a pop in the same function.
+ * gtthread_cleanup_push returns -1, pushing nothing, if out of memory */
+int  gtthread_cleanup_push(void (*routine)(void *), void *arg);
+void gtthread_cleanup_pop(int execute);
+
 /* see man pthread_self(3) */
 gtthread_t gtthread_self(void);
 
+/* scheduling statistics of a thread, see gtthread_getstats */
+typedef struct
+{
+    unsigned long long cpu_ns;      /* time spent running */
+    unsigned long long wait_ns;     /* time runnable but not running */
+    unsigned long long blocked_ns;  /* time queued waiting on a mutex or join */
+    unsigned long voluntary;        /* switches away to yield or wait */
+    unsigned long involuntary;      /* switches away on a tick */
+    unsigned long preemptions;      /* ticks taken while running */
+} gtthread_stats_t;
+
+/* fills stats for a running or terminated thread; returns -1 if there is
+ * no such thread, or with errno ENOSYS if the library was built without
+ * GTTHREAD_ENABLE_STATS */
+int  gtthread_getstats(gtthread_t thread, gtthread_stats_t *stats);
+
+/* writes a table of the statistics of every thread, and their totals, to
+ * the file descriptor fd; fails like gtthread_getstats */
+int  gtthread_dumpstats(int fd);
+
+/* writes the state of every live thread to the file descriptor fd: what
+ * it is waiting on, its run times and a backtrace (link with -rdynamic
+ * for function names) */
+void gtthread_dump(int fd);
+
+/* has the signal sig, e.g. SIGUSR1, write the dump to fd; returns -1 if
+ * the handler cannot be installed or the build is cooperative-only */
+int  gtthread_dump_on_signal(int sig, int fd);
+
+/* starts the sampling profiler: the running thread and its backtrace are
+ * recorded every 'period' microseconds of CPU time, or on every tick if
+ * period is 0, keeping up to nsamples samples (0 for the default).
+ * Setting GTTHREAD_PROF to a path profiles the whole program and writes
+ * the result there at exit. Returns 0 on success; fails with EINVAL for
+ * period 0 when there is no tick, and with ENOSYS in the cooperative-only
+ * build */
+int  gtthread_prof_start(long period, long nsamples);
+void gtthread_prof_stop(void);
+
+/* writes the samples to fd as folded stacks for flame graphs, starting
+ * with the thread's start routine and ID */
+void gtthread_prof_write(int fd);
+
+/* starts recording scheduler events into the file at path, keeping the
+ * last nevents of them (0 for the default); the layout is described in
+ * gtthread_trace.h. Setting the GTTHREAD_TRACE environment variable to a
+ * path has gtthread_init start the trace. Returns 0 on success, and -1
+ * with errno ENOSYS if the library was built without
+ * GTTHREAD_ENABLE_TRACE */
+int  gtthread_trace_start(const char *path, long nevents);
+void gtthread_trace_stop(void);
+
+/* writes, for every mutex locked so far, how often it was taken and
+ * contended, and how long threads waited for it and held it, most waited
+ * for first; fails with ENOSYS unless the library was built with
+ * GTTHREAD_ENABLE_LOCKPROF */
+int  gtthread_lockprof_dump(int fd);
+
+/* why a thread became ready to run, the classes of gtthread_getlatency */
+#define GTTHREAD_LATENCY_NEW 0          /* created */
+#define GTTHREAD_LATENCY_PREEMPTED 1    /* switched away on a tick */
+#define GTTHREAD_LATENCY_YIELDED 2      /* called gtthread_yield */
+#define GTTHREAD_LATENCY_WOKEN 3        /* got its mutex, or its join ended */
+#define GTTHREAD_LATENCY_CLASSES 4
+
+/* how long threads of one class waited to run once ready; percentiles
+ * are accurate to about 3% */
+typedef struct
+{
+    unsigned long long count;
+    unsigned long long total_ns;
+    unsigned long long p50_ns;
+    unsigned long long p90_ns;
+    unsigned long long p99_ns;
+    unsigned long long p999_ns;
+    unsigned long long max_ns;
+} gtthread_latency_t;
+
+/* summarizes the latencies of class cls recorded so far; returns -1 for
+ * an unknown class, or with errno ENOSYS if the library was built
+ * without GTTHREAD_ENABLE_LATENCY */
+int  gtthread_getlatency(int cls, gtthread_latency_t *latency);
+
+/* writes the summary of every class to fd; fails like gtthread_getlatency */
+int  gtthread_dumplatency(int fd);
+
+/* empties the histograms */
+int  gtthread_resetlatency(void);
+
+/* writes how far apart the preemption ticks arrive, how long switching
+ * takes after a tick and after a yield or wait, and the share of the CPU
+ * spent switching; a library built with GTTHREAD_ENABLE_TICKSTATS also
+ * writes this at exit, to stderr or the file named by GTTHREAD_TICKSTATS.
+ * Otherwise fails with ENOSYS */
+int  gtthread_dumpticks(int fd);
+
+/* has the scheduler tune the preemption period between min and max
+ * microseconds: longer while the threads use up whole slices, shorter
+ * while threads that yield early queue behind them, never so short that
+ * switching takes more than about 1% of the CPU. min and max both 0 go
+ * back to the period given to gtthread_init. Returns -1 for bad bounds */
+int  gtthread_adapt_quantum(long min, long max);
+
+/* returns the preemption period of threads without their own, in
+ * microseconds */
+long gtthread_get_quantum(void);
+
+/* gives a thread its own preemption period of usec microseconds, e.g.
+ * long ones for batch threads and short ones for interactive threads;
+ * it gets a full slice of that length whenever it is dispatched. 0 goes
+ * back to the default. Returns -1 if there is no such live thread */
+int  gtthread_set_quantum(gtthread_t thread, long usec);
+
+/* replaces the preemption timer with a monitor kernel thread that only
+ * preempts a thread once it has run for 'limit' microseconds while
+ * others wait, so cooperative programs take no ticks at all. It first
+ * asks the thread to yield at its next gtthread_check_preempt, and only
+ * after another limit sends it a SIGVTALRM, which a cooperative program
+ * never gets. Link with -pthread. Returns -1 if the monitor cannot be
+ * started */
+int  gtthread_monitor_start(long limit);
+
+/* stops the monitor and turns the preemption timer back on */
+void gtthread_monitor_stop(void);
+
+/* set by the monitor when the running thread should yield, and cleared
+ * whenever the scheduler runs; always set in the deterministic mode.
+ * Read it through gtthread_check_preempt */
+extern volatile int gtthread_preempt_requested;
+
+/* what gtthread_check_preempt calls once asked to */
+void gtthread_safepoint(void);
+
+/* a safepoint: yields if the running thread has been asked to, so a
+ * long loop calling it stays preemptible in a cooperative program at
+ * the cost of one load per iteration */
+static inline void gtthread_check_preempt(void)
+{
+    if (__builtin_expect(gtthread_preempt_requested, 0))
+        gtthread_safepoint();
+}
+
+/* makes scheduling reproducible: turns the preemption timer off and
+ * preempts the running thread at safepoints instead, i.e.
+ * gtthread_check_preempt and the return of gtthread_mutex_lock and
+ * gtthread_mutex_unlock, after a pseudo-random number of them drawn from
+ * seed, mean on average. Runs with the same seed switch at the same
+ * points. Unless path is NULL, every switch is recorded to that file for
+ * gtthread_replay_start. Call it right after gtthread_init, or set
+ * GTTHREAD_SEED, and GTTHREAD_RECORD for the file, to start it there with
+ * a mean of 100. Returns -1 if mean is below 1 or the file cannot be
+ * created */
+int  gtthread_deterministic_start(unsigned long seed, long mean, const char *path);
+
+/* runs the deterministic mode again as recorded to path, preempting at
+ * the same safepoints and switching to the same threads, e.g. to profile
+ * a slow interleaving; the first switch that differs is reported on
+ * stderr and the run goes on by the seed from there. Call it where the
+ * recording was started, or set GTTHREAD_REPLAY. Returns -1 if the file
+ * cannot be read or is not a recording */
+int  gtthread_replay_start(const char *path);
+
+/* starts a daemon thread serving run queue length, switch and preemption
+ * counts, threads by state, stack memory and the most contended mutexes
+ * in the Prometheus text format on a Unix socket at path; it does not
+ * keep the program alive. Setting GTTHREAD_METRICS to a path has
+ * gtthread_init start it. Returns 0 on success */
+int  gtthread_metrics_start(const char *path);
+void gtthread_metrics_stop(void);
+
+/* writes the same metrics to fd once */
+int  gtthread_metrics_write(int fd);
+
 
 /* see man pthread_mutex(3); except init does not have the mutexattr parameter,
  * and should behave as if mutexattr is NULL (i.e., default attributes); also,
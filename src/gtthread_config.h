@@ -0,0 +1,55 @@
+/*
+ *  gtthread_config.h
+ *  gtthread
+ *
+ *  Build-time switches for the instrumentation, and for a scheduler
+ *  without preemption. Each defaults to 0, in which case the code it adds
+ *  to the scheduler and mutex paths is not compiled at all and the
+ *  matching API calls fail with ENOSYS. Turn them on here or on the
+ *  command line, after a make clean:
+ *
+ *      make CONFIG="-DGTTHREAD_ENABLE_STATS=1 -DGTTHREAD_ENABLE_TRACE=1"
+ */
+
+#ifndef __GTTHREAD_CONFIG_H
+#define __GTTHREAD_CONFIG_H
+
+/* per-thread run times and switch counts, see gtthread_getstats */
+#ifndef GTTHREAD_ENABLE_STATS
+#define GTTHREAD_ENABLE_STATS 0
+#endif
+
+/* the event ring, see gtthread_trace_start */
+#ifndef GTTHREAD_ENABLE_TRACE
+#define GTTHREAD_ENABLE_TRACE 0
+#endif
+
+/* per-mutex wait and hold times, see gtthread_lockprof_dump */
+#ifndef GTTHREAD_ENABLE_LOCKPROF
+#define GTTHREAD_ENABLE_LOCKPROF 0
+#endif
+
+/* histograms of the delay from ready to running, see gtthread_getlatency */
+#ifndef GTTHREAD_ENABLE_LATENCY
+#define GTTHREAD_ENABLE_LATENCY 0
+#endif
+
+/* tick intervals and switch costs reported at exit, see gtthread_dumpticks */
+#ifndef GTTHREAD_ENABLE_TICKSTATS
+#define GTTHREAD_ENABLE_TICKSTATS 0
+#endif
+
+/* switch threads with swapcontext even where gtthread_switch.c has a
+ * faster switch, e.g. to compare the two */
+#ifndef GTTHREAD_UCONTEXT
+#define GTTHREAD_UCONTEXT 0
+#endif
+
+/* no preemption at all: threads only switch when they yield, wait or
+ * exit, and the scheduler is compiled without signal masking; see
+ * gtthread_init */
+#ifndef GTTHREAD_COOPERATIVE
+#define GTTHREAD_COOPERATIVE 0
+#endif
+
+#endif // __GTTHREAD_CONFIG_H
@@ -0,0 +1,216 @@
+/**********************************************************************
+gtthread_dump.c.
+
+This file contains the thread dump: one entry per live thread with its
+state, what it waits on, its run times if the library keeps statistics
+and a backtrace. A debugger only sees the kernel thread, so this is the
+way to find out what each gtthread is doing in a stalled process. The
+backtraces of threads that are not running are walked from the frame
+pointers in their saved contexts; function names need the program
+linked with -rdynamic.
+ **********************************************************************/
+
+#define _GNU_SOURCE /* REG_RIP and REG_RBP */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+#define DUMP_DEPTH 32
+
+/* what dump_thread writes to and counts */
+typedef struct
+{
+    int fd;
+    long dead;
+} dump_t;
+
+static int dump_fd = -1;
+
+static void dump_handler(int sig);
+static void dump_write(int fd);
+static void dump_thread(thread_t* t, void* arg);
+static int dump_backtrace(thread_t* t, void** pcs, int max);
+
+/*
+  Writes the dump to fd.
+ */
+void gtthread_dump(int fd)
+{
+    VTALRM_BLOCK();
+    dump_write(fd);
+    VTALRM_UNBLOCK();
+}
+
+/*
+  Installs a handler that writes the dump to fd whenever the process gets
+  signal sig. The signal is added to the set the scheduler blocks while
+  it changes its queues, so it is held back until they are consistent.
+  Returns -1 if the handler cannot be installed, as in a cooperative-only
+  build, where nothing is held back.
+ */
+int gtthread_dump_on_signal(int sig, int fd)
+{
+    struct sigaction act;
+    void* pc;
+
+    /* backtrace loads libgcc on first use, which must not happen in the
+     * handler; the clock is calibrated for the same reason */
+    backtrace(&pc, 1);
+    clock_ticks_per_us();
+
+    memset(&act, '\0', sizeof(act));
+    act.sa_handler = &dump_handler;
+    act.sa_flags = SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    sigaddset(&act.sa_mask, SIGVTALRM);
+
+    VTALRM_BLOCK();
+    if (signals_enable() < 0 || sigaction(sig, &act, NULL) < 0)
+    {
+        VTALRM_UNBLOCK();
+        return -1;
+    }
+    dump_fd = fd;
+    sigaddset(&vtalrm, sig);
+    VTALRM_UNBLOCK();
+    return 0;
+}
+
+static void dump_handler(int sig)
+{
+    dump_write(dump_fd);
+}
+
+/*
+ * Writes a line per live thread, followed by its backtrace, and a count
+ * of the terminated ones. SIGVTALRM must be blocked.
+ */
+static void dump_write(int fd)
+{
+    dump_t d;
+    char line[128];
+    int len;
+
+    len = snprintf(line, sizeof(line), "gtthread dump, running thread %lu\n",
+                   thread_current()->tid);
+    if (write(fd, line, len) < 0)
+        return;
+    d.fd = fd;
+    d.dead = 0;
+    thread_foreach(dump_thread, &d);
+
+    len = snprintf(line, sizeof(line), "%ld terminated threads not shown\n", d.dead);
+    if (write(fd, line, len) < 0)
+        return;
+}
+
+static void dump_thread(thread_t* t, void* arg)
+{
+    dump_t* d = (dump_t*) arg;
+    void* pcs[DUMP_DEPTH];
+#if GTTHREAD_ENABLE_STATS
+    gtthread_stats_t st;
+#endif
+    char what[64];
+    char line[256];
+    int len, n;
+
+    if (t->state != GTTHREAD_RUNNING)
+    {
+        d->dead++;
+        return;
+    }
+
+    if (t == thread_current())
+        snprintf(what, sizeof(what), "running");
+    else if (t->parked)
+        snprintf(what, sizeof(what), "parked over its CPU budget");
+    else if (t->waiting != NULL)
+        snprintf(what, sizeof(what), "blocked on mutex %p", (void*) t->waiting);
+    else if (t->joining != 0)
+        snprintf(what, sizeof(what), "joining thread %lu", t->joining);
+    else if (t->ucp == NULL)
+        snprintf(what, sizeof(what), "not started");
+    else
+        snprintf(what, sizeof(what), "runnable");
+
+#if GTTHREAD_ENABLE_STATS
+    thread_stats(t, &st, clock_ticks());
+    len = snprintf(line, sizeof(line),
+                   "thread %lu: %s%s, cpu %lluus, waiting %lluus, blocked %lluus\n",
+                   t->tid, what, t->cancel_pending ? ", cancel pending" : "",
+                   st.cpu_ns / 1000, st.wait_ns / 1000, st.blocked_ns / 1000);
+#else
+    len = snprintf(line, sizeof(line), "thread %lu: %s%s\n", t->tid, what,
+                   t->cancel_pending ? ", cancel pending" : "");
+#endif
+    if (write(d->fd, line, len) < 0)
+        return;
+
+    /* a thread that has not started has no stack; show what it will run */
+    if (t->ucp == NULL && t != thread_current())
+    {
+        pcs[0] = (void*) t->proc;
+        n = 1;
+    }
+    else
+        n = dump_backtrace(t, pcs, DUMP_DEPTH);
+    backtrace_symbols_fd(pcs, n, d->fd);
+}
+
+/*
+ * Collects the return addresses on the stack of a thread. The running
+ * thread is asked directly; for the others, the frame pointer chain is
+ * followed from the saved context for as long as it stays on the
+ * thread's stack and goes up.
+ */
+static int dump_backtrace(thread_t* t, void** pcs, int max)
+{
+    if (t == thread_current())
+        return backtrace(pcs, max);
+#if CTX_ASM || (defined(__x86_64__) && defined(__GLIBC__))
+    {
+        uintptr_t* fp;
+        void* pc;
+        uintptr_t lo, hi;
+        int n = 0;
+
+#if CTX_ASM
+        ctx_frame(t, &pc, &fp);
+#else
+        fp = (uintptr_t*) t->ucp->uc_mcontext.gregs[REG_RBP];
+        pc = (void*) t->ucp->uc_mcontext.gregs[REG_RIP];
+#endif
+
+        /* the main thread runs on the process stack, bounds unknown */
+        if (t->ucp->uc_stack.ss_size != 0)
+        {
+            lo = (uintptr_t) t->ucp->uc_stack.ss_sp;
+            hi = lo + t->ucp->uc_stack.ss_size;
+        }
+        else
+        {
+            lo = (uintptr_t) fp;
+            hi = lo + (8 << 20);
+        }
+
+        pcs[n++] = pc;
+        while (n < max && (uintptr_t) fp >= lo && (uintptr_t) (fp + 2) <= hi
+               && ((uintptr_t) fp & 7) == 0 && fp[1] != 0)
+        {
+            pcs[n++] = (void*) fp[1];
+            if (fp[0] <= (uintptr_t) fp)
+                break;
+            fp = (uintptr_t*) fp[0];
+        }
+        return n;
+    }
+#else
+    return 0;
+#endif
+}
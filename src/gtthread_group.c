@@ -0,0 +1,386 @@
+/**********************************************************************
+gtthread_group.c.
+
+This file contains thread groups, which share the CPU by weight, and
+the CPU budgets of threads and groups. Each group has a ready queue of
+its own, and the scheduler first picks the group that has had the least
+CPU time for its weight, then the thread at the front of that group's
+queue. A group's share thus does not grow with the number of threads
+in it: a tenant running 10,000 threads gets the same time as one running
+10 at the same weight. Threads in no group are in group_default, of
+weight GTTHREAD_GROUP_WEIGHT.
+
+The time each group has had is kept as a virtual runtime, the clock
+ticks its threads have run scaled by GTTHREAD_GROUP_WEIGHT / weight, as
+in Linux's CFS. A group that had no thread ready to run catches up with
+the least virtual runtime of the others when it gets one, so it cannot
+bank the time it was idle. Threads woken by a mutex or yielded to keep
+their place ahead of the queue only while their group is within a slice
+of the least virtual runtime.
+
+A thread can be given a budget of CPU time per GTTHREAD_BUDGET_PERIOD,
+and a group capped at a percentage of the CPU, which is a budget of that
+much of the period. A budget is a token bucket in clock ticks: the time
+run is taken out of it when charged, and it fills back at the rate of
+the budget, up to one period's worth. A thread whose bucket is empty on
+a switch is parked out of the ready queue until it has tokens again; a
+group's threads stay queued but are not picked. Either way they do not
+run even when nothing else is ready, and the process then sleeps.
+
+Reading the clock on every switch is only done while there are groups
+besides group_default or budgets, so programs that use neither keep a
+scheduler that reads no clock.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+/* how far ahead of the others a group may be and still have a woken or
+ * yielded-to thread run before the pick, in microseconds */
+#define GROUP_SLACK_US 1000
+
+group_t group_default = { .weight = GTTHREAD_GROUP_WEIGHT };
+int group_count = 1;
+long budget_threads;
+
+static uint64_t group_since;        /* the last time charged */
+static uint64_t group_min_vruntime; /* never decreases */
+
+static void group_charge(uint64_t now);
+static int group_throttled(group_t* g, uint64_t now);
+static void group_idle(thread_t* prev, uint64_t now, uint64_t parked);
+static void budget_set(budget_t* b, uint64_t size, uint64_t now);
+static void budget_fill(budget_t* b, uint64_t now);
+static double budget_period(void);
+
+/*
+  Creates a group whose threads together get CPU time in proportion to
+  weight, and at most cap percent of the CPU if cap is not 0. Returns -1
+  if the weight is 0, the cap is not between 0 and 100 or out of memory.
+ */
+int gtthread_group_create(gtthread_group_t* group, unsigned long weight, int cap)
+{
+    group_t* g;
+
+    if (weight == 0 || cap < 0 || cap > 100)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    g = (group_t*) calloc(1, sizeof(group_t));
+    if (g == NULL)
+        return -1;
+    g->weight = weight;
+    clock_ticks_per_us();
+
+    VTALRM_BLOCK();
+    /* the time up to here is nobody's */
+    if (!sched_charging())
+        group_since = clock_ticks();
+    if (cap != 0)
+        budget_set(&g->cap, (uint64_t) (budget_period() * cap / 100),
+                   clock_ticks());
+    g->vruntime = group_min_vruntime;
+    g->next = group_default.next;
+    group_default.next = g;
+    group_count++;
+    VTALRM_UNBLOCK();
+    *group = g;
+    return 0;
+}
+
+/*
+  Moves a live thread into group, or back into none if group is NULL;
+  the threads it creates from then on start in the same group. Returns
+  -1 if there is no such live thread.
+ */
+int gtthread_group_attach(gtthread_group_t group, gtthread_t thread)
+{
+    group_t* g = group != NULL ? group : &group_default;
+    thread_t* t;
+
+    VTALRM_BLOCK();
+    t = thread_current();
+    if (t->tid != thread)
+        t = thread_get(thread);
+    if (t == NULL || t->state != GTTHREAD_RUNNING || t->group == NULL)
+    {
+        VTALRM_UNBLOCK();
+        errno = ESRCH;
+        return -1;
+    }
+    if (t->group != g)
+    {
+        /* what the running thread has used so far is its old group's */
+        if (sched_charging() && t == thread_current())
+            group_charge(clock_ticks());
+        thread_regroup(t, g);
+    }
+    VTALRM_UNBLOCK();
+    return 0;
+}
+
+/*
+  Gives a live thread a budget of ns nanoseconds of CPU per
+  GTTHREAD_BUDGET_PERIOD, or takes its budget away if ns is 0. Returns
+  -1 if ns is out of range or there is no such live thread.
+ */
+int gtthread_set_cpu_budget(gtthread_t thread, long ns)
+{
+    thread_t* t;
+    uint64_t now;
+
+    if (ns < 0 || ns > GTTHREAD_BUDGET_PERIOD)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    clock_ticks_per_us();
+
+    VTALRM_BLOCK();
+    t = thread_current();
+    if (t->tid != thread)
+        t = thread_get(thread);
+    if (t == NULL || t->state != GTTHREAD_RUNNING || t->group == NULL)
+    {
+        VTALRM_UNBLOCK();
+        errno = ESRCH;
+        return -1;
+    }
+
+    /* what the running thread has used so far is charged to the old one */
+    now = clock_ticks();
+    if (!sched_charging())
+        group_since = now;
+    else if (t == thread_current())
+        group_charge(now);
+    budget_threads += (ns != 0) - (t->budget.size != 0);
+    budget_set(&t->budget, (uint64_t) (budget_period() * ns / GTTHREAD_BUDGET_PERIOD),
+               now);
+    if (t->parked)
+        thread_unpark(now);
+    VTALRM_UNBLOCK();
+    return 0;
+}
+
+/*
+  Frees a group that no live thread is in. Returns -1 with errno EBUSY
+  if some still are, or with EINVAL if group is NULL, the default group,
+  or not a group that exists.
+ */
+int gtthread_group_destroy(gtthread_group_t group)
+{
+    group_t** link;
+
+    VTALRM_BLOCK();
+    /* look it up before touching it, as it may have been freed already */
+    for (link = &group_default.next; *link != NULL && *link != group;
+         link = &(*link)->next)
+        ;
+    if (group == NULL || *link == NULL)
+    {
+        VTALRM_UNBLOCK();
+        errno = EINVAL;
+        return -1;
+    }
+    if (group->members > 0)
+    {
+        VTALRM_UNBLOCK();
+        errno = EBUSY;
+        return -1;
+    }
+    *link = group->next;
+    group_count--;
+    VTALRM_UNBLOCK();
+    free(group);
+    return 0;
+}
+
+/*
+ * Picks the group with the least virtual runtime among those with a
+ * thread ready to run and under their cap. The running thread's group
+ * counts towards the least virtual runtime, so that one that has
+ * waited long does not catch up past it.
+ */
+group_t* group_pick(thread_t* prev)
+{
+    group_t* g;
+    group_t* best;
+    uint64_t now, least, parked;
+    int queued;
+
+    for (;;)
+    {
+        now = clock_ticks();
+        group_charge(now);
+        parked = budget_threads > 0 ? thread_unpark(now) : UINT64_MAX;
+        best = NULL;
+        queued = 0;
+        for (g = &group_default; g != NULL; g = g->next)
+        {
+            if (g->queue.n == 0)
+                continue;
+            queued = 1;
+            if (!group_throttled(g, now)
+                && (best == NULL || g->vruntime < best->vruntime))
+                best = g;
+        }
+
+        least = best != NULL ? best->vruntime : UINT64_MAX;
+        if (prev != NULL && prev->group->vruntime < least)
+            least = prev->group->vruntime;
+        if (least != UINT64_MAX && least > group_min_vruntime)
+            group_min_vruntime = least;
+
+        if (best != NULL)
+            return best;
+        /* one that only polls a mutex or a join sleeps as well while the
+         * thread it waits for may be parked */
+        if (prev != NULL
+            ? !group_throttled(prev->group, now) && budget_due(&prev->budget, now) == now
+              && (parked == UINT64_MAX || !thread_blocked(prev))
+            : !queued && parked == UINT64_MAX)
+            return NULL;
+        group_idle(prev, now, parked);
+    }
+}
+
+int group_admits(group_t* g)
+{
+    uint64_t now = clock_ticks();
+
+    group_charge(now);
+    return !group_throttled(g, now)
+        && g->vruntime <= group_min_vruntime
+                          + (uint64_t) (GROUP_SLACK_US * clock_ticks_per_us());
+}
+
+void group_wake(group_t* g)
+{
+    if (g->vruntime < group_min_vruntime)
+        g->vruntime = group_min_vruntime;
+}
+
+/*
+ * Charges the time since the last charge to the running thread's group,
+ * and to its budget and its group's cap if it has them.
+ */
+static void group_charge(uint64_t now)
+{
+    thread_t* t = thread_current();
+    group_t* g = t->group;
+    uint64_t used = now - group_since;
+
+    group_since = now;
+    g->vruntime += used * GTTHREAD_GROUP_WEIGHT / g->weight;
+    if (g->cap.size != 0)
+    {
+        budget_fill(&g->cap, now);
+        g->cap.tokens -= used;
+    }
+    if (t->budget.size != 0)
+    {
+        budget_fill(&t->budget, now);
+        t->budget.tokens -= used;
+    }
+}
+
+/*
+ * Tells whether a group has used up its cap for now.
+ */
+static int group_throttled(group_t* g, uint64_t now)
+{
+    return budget_due(&g->cap, now) != now;
+}
+
+/*
+ * Sleeps until the first of the threads that could run may: prev, the
+ * parked threads, whose first is due at 'parked', and those queued in
+ * capped groups, as none of them may run before.
+ */
+static void group_idle(thread_t* prev, uint64_t now, uint64_t parked)
+{
+    struct timespec nap;
+    uint64_t until = parked;
+    uint64_t due;
+    group_t* g;
+    double us;
+
+    for (g = &group_default; g != NULL; g = g->next)
+        if (g->cap.size != 0 && (g->queue.n > 0 || (prev != NULL && prev->group == g)))
+        {
+            due = budget_due(&g->cap, now);
+            if (due < until)
+                until = due;
+        }
+    if (prev != NULL && prev->budget.size != 0
+        && (due = budget_due(&prev->budget, now)) < until)
+        until = due;
+    if (until == UINT64_MAX || until <= now)
+        return;
+
+    us = (until - now) / clock_ticks_per_us();
+    nap.tv_sec = (time_t) (us / 1000000);
+    nap.tv_nsec = (long) ((us - nap.tv_sec * 1e6) * 1000);
+    nanosleep(&nap, NULL);
+
+    /* sleeping is not running */
+    group_since = clock_ticks();
+}
+
+/*
+ * Gives a bucket a size, 0 for no limit. It starts empty, so that what
+ * it limits gets its rate from the start rather than a period's worth on
+ * top of it.
+ */
+static void budget_set(budget_t* b, uint64_t size, uint64_t now)
+{
+    b->size = (int64_t) size;
+    b->tokens = 0;
+    b->stamp = now;
+}
+
+/*
+ * Adds the whole tokens that have come back since the bucket was last
+ * filled, up to its size. The stamp only moves on by the time those took,
+ * so that filling on every switch does not lose the fractions.
+ */
+static void budget_fill(budget_t* b, uint64_t now)
+{
+    double period = budget_period();
+    int64_t back = (int64_t) ((now - b->stamp) / period * b->size);
+
+    if (b->tokens + back >= b->size)
+    {
+        b->tokens = b->size;
+        b->stamp = now;
+    }
+    else if (back > 0)
+    {
+        b->tokens += back;
+        b->stamp += (uint64_t) (back * period / b->size);
+    }
+}
+
+uint64_t budget_due(budget_t* b, uint64_t now)
+{
+    if (b->size == 0)
+        return now;
+    budget_fill(b, now);
+    if (b->tokens > 0)
+        return now;
+    return now + (uint64_t) ((1 - b->tokens) * budget_period() / b->size) + 1;
+}
+
+/*
+ * Returns GTTHREAD_BUDGET_PERIOD in clock_ticks.
+ */
+static double budget_period(void)
+{
+    return GTTHREAD_BUDGET_PERIOD / 1000.0 * clock_ticks_per_us();
+}
@@ -0,0 +1,55 @@
+/**********************************************************************
+gtthread_hist.c.
+
+This file contains the histogram used for the latency and tick
+diagnostics. It is log-linear, as in HdrHistogram: values below
+2^HIST_BITS clock ticks get a bucket each, and every power of two above
+is split into 2^HIST_BITS buckets, so any value is placed within about
+3% using a fixed table and no arithmetic beyond a bit scan.
+ **********************************************************************/
+
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+void hist_record(hist_t* h, uint64_t ticks)
+{
+    int shift;
+
+    if (ticks < HIST_SUB)
+        h->counts[ticks]++;
+    else
+    {
+        shift = 63 - __builtin_clzll(ticks) - HIST_BITS;
+        h->counts[(shift + 1) * HIST_SUB + (ticks >> shift) - HIST_SUB]++;
+    }
+    h->n++;
+    h->total += ticks;
+    if (ticks > h->max)
+        h->max = ticks;
+}
+
+uint64_t hist_at(const hist_t* h, double fraction)
+{
+    uint64_t want = (uint64_t) (fraction * h->n + 0.999999);
+    uint64_t seen = 0, top;
+    int b, shift;
+
+    if (want == 0)
+        want = 1;
+    for (b = 0; b < HIST_BUCKETS; b++)
+    {
+        seen += h->counts[b];
+        if (seen >= want)
+            break;
+    }
+    if (b >= HIST_BUCKETS)
+        return h->max;
+    if (b < HIST_SUB)
+        top = b;
+    else
+    {
+        shift = b / HIST_SUB - 1;
+        top = ((uint64_t) (HIST_SUB + b % HIST_SUB + 1) << shift) - 1;
+    }
+    return top < h->max ? top : h->max;
+}
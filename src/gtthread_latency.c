@@ -0,0 +1,122 @@
+/**********************************************************************
+gtthread_latency.c.
+
+This file contains the scheduling latency histograms: how long a thread
+that became ready to run waited in the ready queue before it was
+dispatched, kept separately for each reason it became ready. The
+scheduler stamps a thread when it queues or wakes it and records the
+delay when it dispatches it, see LATENCY_READY and LATENCY_RUN; the
+histograms are described in gtthread_hist.c. Unless the library is
+built with GTTHREAD_ENABLE_LATENCY, the calls here fail with ENOSYS.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+#if GTTHREAD_ENABLE_LATENCY
+static hist_t latency_hists[GTTHREAD_LATENCY_CLASSES];
+
+static const char* latency_names[GTTHREAD_LATENCY_CLASSES] =
+    {"new", "preempted", "yielded", "woken"};
+#endif
+
+/*
+  Summarizes the latencies recorded for one class of wakeup since the
+  start or the last gtthread_resetlatency. Returns -1 if there is no such
+  class.
+ */
+int gtthread_getlatency(int cls, gtthread_latency_t* latency)
+{
+#if GTTHREAD_ENABLE_LATENCY
+    hist_t* h;
+    double rate;
+
+    if (cls < 0 || cls >= GTTHREAD_LATENCY_CLASSES)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    rate = clock_ticks_per_us() / 1000;
+    h = (hist_t*) malloc(sizeof(hist_t));
+    if (h == NULL)
+        return -1;
+    VTALRM_BLOCK();
+    memcpy(h, &latency_hists[cls], sizeof(hist_t));
+    VTALRM_UNBLOCK();
+
+    latency->count = h->n;
+    latency->total_ns = h->total / rate;
+    latency->p50_ns = hist_at(h, 0.5) / rate;
+    latency->p90_ns = hist_at(h, 0.9) / rate;
+    latency->p99_ns = hist_at(h, 0.99) / rate;
+    latency->p999_ns = hist_at(h, 0.999) / rate;
+    latency->max_ns = h->max / rate;
+    free(h);
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*
+  Writes a line per class with the count, mean, percentiles and maximum
+  in nanoseconds. Returns -1 if they cannot be read.
+ */
+int gtthread_dumplatency(int fd)
+{
+#if GTTHREAD_ENABLE_LATENCY
+    gtthread_latency_t l;
+    int i;
+
+    dprintf(fd, "%-10s %10s %10s %10s %10s %10s %10s %10s\n", "class",
+            "count", "mean_ns", "p50_ns", "p90_ns", "p99_ns", "p99.9_ns",
+            "max_ns");
+    for (i = 0; i < GTTHREAD_LATENCY_CLASSES; i++)
+    {
+        if (gtthread_getlatency(i, &l) < 0)
+            return -1;
+        dprintf(fd, "%-10s %10llu %10llu %10llu %10llu %10llu %10llu %10llu\n",
+                latency_names[i], l.count,
+                l.count > 0 ? l.total_ns / l.count : 0, l.p50_ns, l.p90_ns,
+                l.p99_ns, l.p999_ns, l.max_ns);
+    }
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*
+  Empties the histograms, e.g. between the runs of an experiment.
+ */
+int gtthread_resetlatency(void)
+{
+#if GTTHREAD_ENABLE_LATENCY
+    VTALRM_BLOCK();
+    memset(latency_hists, '\0', sizeof(latency_hists));
+    VTALRM_UNBLOCK();
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+#if GTTHREAD_ENABLE_LATENCY
+const char* latency_name(int cls)
+{
+    return latency_names[cls];
+}
+
+void latency_record(int cls, uint64_t ticks)
+{
+    hist_record(&latency_hists[cls], ticks);
+}
+#endif
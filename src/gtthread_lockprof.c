@@ -0,0 +1,168 @@
+/**********************************************************************
+gtthread_lockprof.c.
+
+This file contains the lock profiler. Mutexes are plain queues, so the
+counts are kept in a side table keyed by the mutex address: how often
+each mutex was taken and found taken, how long threads waited for it
+and how long they held it. Unless the library is built with
+GTTHREAD_ENABLE_LOCKPROF, nothing is counted and gtthread_lockprof_dump
+fails with ENOSYS.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+#if GTTHREAD_ENABLE_LOCKPROF
+/* open addressing, at most half full */
+static lockprof_t* lockprof_table;
+static size_t lockprof_cap;
+static size_t lockprof_used;
+
+static lockprof_t* lockprof_find(gtthread_mutex_t* mutex);
+static int lockprof_grow(void);
+static int lockprof_cmp(const void* a, const void* b);
+#endif
+
+/*
+  Writes a line per mutex locked so far, those threads waited longest for
+  first. Returns -1 if the table cannot be copied.
+ */
+int gtthread_lockprof_dump(int fd)
+{
+#if GTTHREAD_ENABLE_LOCKPROF
+    double rate = clock_ticks_per_us();
+    lockprof_t* rows;
+    lockprof_t* r;
+    size_t i, n;
+
+    if ((rows = lockprof_sorted(&n)) == NULL)
+        return -1;
+    dprintf(fd, "%-18s %10s %10s %12s %12s %12s %12s\n", "mutex", "acquired",
+            "contended", "wait_us", "max_wait_us", "hold_us", "max_hold_us");
+    for (i = 0; i < n; i++)
+    {
+        r = &rows[i];
+        dprintf(fd, "%-18p %10lu %10lu %12.0f %12.0f %12.0f %12.0f\n",
+                (void*) r->mutex, r->acquired, r->contended,
+                r->wait_ticks / rate, r->max_wait / rate,
+                r->hold_ticks / rate, r->max_hold / rate);
+    }
+    free(rows);
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+#if GTTHREAD_ENABLE_LOCKPROF
+lockprof_t* lockprof_sorted(size_t* n)
+{
+    lockprof_t* rows;
+    size_t i;
+
+    *n = 0;
+    VTALRM_BLOCK();
+    rows = (lockprof_t*) malloc((lockprof_used + 1) * sizeof(lockprof_t));
+    if (rows == NULL)
+    {
+        VTALRM_UNBLOCK();
+        return NULL;
+    }
+    for (i = 0; i < lockprof_cap; i++)
+        if (lockprof_table[i].mutex != NULL)
+            rows[(*n)++] = lockprof_table[i];
+    VTALRM_UNBLOCK();
+
+    qsort(rows, *n, sizeof(lockprof_t), lockprof_cmp);
+    return rows;
+}
+
+void lockprof_acquired(gtthread_mutex_t* mutex, int contended, uint64_t wait)
+{
+    lockprof_t* e = lockprof_find(mutex);
+
+    if (e == NULL)
+        return;
+    e->acquired++;
+    if (contended)
+    {
+        e->contended++;
+        e->wait_ticks += wait;
+        if (wait > e->max_wait)
+            e->max_wait = wait;
+    }
+    e->since = clock_ticks();
+}
+
+void lockprof_released(gtthread_mutex_t* mutex)
+{
+    lockprof_t* e = lockprof_find(mutex);
+    uint64_t hold;
+
+    if (e == NULL)
+        return;
+    hold = clock_ticks() - e->since;
+    e->hold_ticks += hold;
+    if (hold > e->max_hold)
+        e->max_hold = hold;
+}
+
+/* returns the entry of mutex, adding it if needed; NULL if out of memory */
+static lockprof_t* lockprof_find(gtthread_mutex_t* mutex)
+{
+    size_t i;
+
+    if ((lockprof_used + 1) * 2 > lockprof_cap && lockprof_grow() < 0)
+        return NULL;
+
+    i = (size_t) (((uintptr_t) mutex * 0x9E3779B97F4A7C15ULL) >> 32);
+    for (;; i++)
+    {
+        i &= lockprof_cap - 1;
+        if (lockprof_table[i].mutex == mutex)
+            return &lockprof_table[i];
+        if (lockprof_table[i].mutex == NULL)
+            break;
+    }
+    memset(&lockprof_table[i], '\0', sizeof(lockprof_t));
+    lockprof_table[i].mutex = mutex;
+    lockprof_used++;
+    return &lockprof_table[i];
+}
+
+static int lockprof_grow(void)
+{
+    lockprof_t* old = lockprof_table;
+    size_t oldcap = lockprof_cap;
+    size_t i;
+
+    lockprof_cap = oldcap != 0 ? oldcap * 2 : 64;
+    lockprof_table = (lockprof_t*) calloc(lockprof_cap, sizeof(lockprof_t));
+    if (lockprof_table == NULL)
+    {
+        lockprof_table = old;
+        lockprof_cap = oldcap;
+        return -1;
+    }
+    lockprof_used = 0;
+    for (i = 0; i < oldcap; i++)
+        if (old[i].mutex != NULL)
+            *lockprof_find(old[i].mutex) = old[i];
+    free(old);
+    return 0;
+}
+
+static int lockprof_cmp(const void* a, const void* b)
+{
+    uint64_t x = ((const lockprof_t*) a)->wait_ticks;
+    uint64_t y = ((const lockprof_t*) b)->wait_ticks;
+
+    return (x < y) - (x > y);
+}
+#endif
@@ -0,0 +1,393 @@
+/**********************************************************************
+gtthread_metrics.c.
+
+This file contains the metrics endpoint: a daemon gtthread that serves
+the scheduler's state in the Prometheus text format on a Unix socket.
+The kernel thread is shared with the program, so the server never
+blocks: its sockets are non-blocking and it yields whenever it would
+wait. The state is copied with SIGVTALRM blocked and formatted after, so
+a scrape holds the scheduler for no longer than a walk of the queues.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+/* how often an idle server looks for a connection, in microseconds */
+#define METRICS_POLL_US 1000
+/* how long a client has to send its request and read the reply */
+#define METRICS_REQUEST_US 100000
+#define METRICS_REPLY_US 5000000
+/* mutexes listed by waiters, and from the lock profile */
+#define METRICS_MUTEXES 10
+
+typedef struct
+{
+    gtthread_mutex_t* mutex;
+    long waiters;
+} metrics_mutex_t;
+
+/* what is copied of the scheduler with SIGVTALRM blocked */
+typedef struct
+{
+    unsigned long switches;
+    unsigned long preemptions;
+    unsigned long starvations;
+    long runnable;
+    long throttled;             /* parked over their CPU budget */
+    long not_started;
+    long blocked;
+    long joining;
+    long done;
+    long cancelled;
+    size_t stack_bytes;
+    int nmutexes;
+    metrics_mutex_t mutexes[METRICS_MUTEXES];
+} metrics_t;
+
+static int metrics_fd = -1;
+static int metrics_stopping;
+static gtthread_t metrics_thread;
+static char metrics_path[sizeof(((struct sockaddr_un*) 0)->sun_path)];
+
+static void* metrics_server(void* arg);
+static void metrics_serve(int fd);
+static char* metrics_format(size_t* len);
+static void metrics_collect(thread_t* t, void* arg);
+static int metrics_cmp(const void* a, const void* b);
+static uint64_t metrics_us(void);
+
+/*
+  Starts serving the metrics on a Unix socket at path, replacing whatever
+  file is there. The server is a daemon thread: it does not keep the
+  program from ending. Returns -1 if the socket cannot be set up or a
+  server is already running.
+ */
+int gtthread_metrics_start(const char* path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (metrics_fd >= 0 || strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = metrics_fd >= 0 ? EBUSY : ENAMETOOLONG;
+        return -1;
+    }
+    memset(&addr, '\0', sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0
+        || listen(fd, 16) < 0
+        || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    strcpy(metrics_path, path);
+    metrics_fd = fd;
+    metrics_stopping = 0;
+    gtthread_create(&metrics_thread, metrics_server, NULL);
+    VTALRM_BLOCK();
+    thread_daemon(thread_get(metrics_thread));
+    VTALRM_UNBLOCK();
+    return 0;
+}
+
+/*
+  Stops the server and removes its socket. A scrape in progress is cut
+  short.
+ */
+void gtthread_metrics_stop(void)
+{
+    if (metrics_fd < 0 || gtthread_self() == metrics_thread)
+        return;
+    metrics_stopping = 1;
+    gtthread_join(metrics_thread, NULL);
+}
+
+/*
+  Writes the metrics to fd once. Returns -1 if they cannot be formatted
+  or written.
+ */
+int gtthread_metrics_write(int fd)
+{
+    size_t len;
+    char* text = metrics_format(&len);
+    ssize_t n;
+
+    if (text == NULL)
+        return -1;
+    n = write(fd, text, len);
+    free(text);
+    return n == (ssize_t) len ? 0 : -1;
+}
+
+static void* metrics_server(void* arg)
+{
+    uint64_t last = 0;
+    int fd;
+
+    while (!metrics_stopping)
+    {
+        /* looking costs a system call, so not on every round */
+        if (metrics_us() - last < METRICS_POLL_US)
+        {
+            gtthread_yield();
+            continue;
+        }
+        last = metrics_us();
+        fd = accept(metrics_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0)
+            metrics_serve(fd);
+        close(fd);
+    }
+
+    close(metrics_fd);
+    unlink(metrics_path);
+    metrics_fd = -1;
+    return NULL;
+}
+
+/*
+ * Answers one client. An HTTP request, as sent by Prometheus through a
+ * socket-aware proxy, gets an HTTP reply; a client that sends nothing,
+ * such as socat or nc -U, gets the bare text once it has been quiet for
+ * a while.
+ */
+static void metrics_serve(int fd)
+{
+    char req[1024];
+    char head[128];
+    char* text;
+    size_t n = 0, len, off;
+    uint64_t deadline = metrics_us() + METRICS_REQUEST_US;
+    ssize_t r;
+    int hlen = 0;
+
+    while (n < sizeof(req) - 1 && !metrics_stopping)
+    {
+        r = read(fd, req + n, sizeof(req) - 1 - n);
+        if (r > 0)
+        {
+            n += r;
+            req[n] = '\0';
+            if (strstr(req, "\r\n\r\n") != NULL || strstr(req, "\n\n") != NULL)
+                break;
+        }
+        else if (r == 0 || (errno != EAGAIN && errno != EINTR))
+            break;
+        else if (metrics_us() > deadline)
+            break;
+        else
+            gtthread_yield();
+    }
+    req[n] = '\0';
+
+    if ((text = metrics_format(&len)) == NULL)
+        return;
+    if (strncmp(req, "GET ", 4) == 0)
+        hlen = snprintf(head, sizeof(head),
+                        "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Content-Length: %zu\r\n\r\n", len);
+
+    /* a slow reader makes the server wait, not the program */
+    deadline = metrics_us() + METRICS_REPLY_US;
+    for (off = 0; off < hlen + len && !metrics_stopping; )
+    {
+        if (off < (size_t) hlen)
+            r = send(fd, head + off, hlen - off, MSG_NOSIGNAL);
+        else
+            r = send(fd, text + off - hlen, len - (off - hlen), MSG_NOSIGNAL);
+        if (r > 0)
+            off += r;
+        else if ((errno != EAGAIN && errno != EINTR) || metrics_us() > deadline)
+            break;
+        else
+            gtthread_yield();
+    }
+    free(text);
+}
+
+/*
+ * Formats the metrics into a malloc'ed buffer, returning NULL if out of
+ * memory.
+ */
+static char* metrics_format(size_t* len)
+{
+    metrics_t m;
+    char* text = NULL;
+    FILE* f;
+    int i;
+#if GTTHREAD_ENABLE_LOCKPROF
+    double rate = clock_ticks_per_us() * 1e6;
+    lockprof_t* rows;
+    size_t nrows, j;
+#endif
+
+    memset(&m, '\0', sizeof(m));
+    VTALRM_BLOCK();
+    m.switches = sched_switches;
+    m.preemptions = sched_preemptions;
+    m.starvations = sched_starvations;
+    thread_foreach(metrics_collect, &m);
+    VTALRM_UNBLOCK();
+    qsort(m.mutexes, m.nmutexes, sizeof(metrics_mutex_t), metrics_cmp);
+
+    if ((f = open_memstream(&text, len)) == NULL)
+        return NULL;
+
+    fprintf(f, "# HELP gtthread_switches_total Context switches since gtthread_init.\n"
+               "# TYPE gtthread_switches_total counter\n"
+               "gtthread_switches_total %lu\n", m.switches);
+    fprintf(f, "# HELP gtthread_preemptions_total Preemption ticks taken.\n"
+               "# TYPE gtthread_preemptions_total counter\n"
+               "gtthread_preemptions_total %lu\n", m.preemptions);
+    fprintf(f, "# HELP gtthread_starvations_total Dispatches given to a starving thread first.\n"
+               "# TYPE gtthread_starvations_total counter\n"
+               "gtthread_starvations_total %lu\n", m.starvations);
+    fprintf(f, "# HELP gtthread_run_queue_length Threads ready to run, not counting the running one.\n"
+               "# TYPE gtthread_run_queue_length gauge\n"
+               "gtthread_run_queue_length %ld\n", m.runnable + m.not_started);
+    fprintf(f, "# HELP gtthread_threads Threads by state.\n"
+               "# TYPE gtthread_threads gauge\n"
+               "gtthread_threads{state=\"running\"} 1\n"
+               "gtthread_threads{state=\"runnable\"} %ld\n"
+               "gtthread_threads{state=\"throttled\"} %ld\n"
+               "gtthread_threads{state=\"not_started\"} %ld\n"
+               "gtthread_threads{state=\"blocked\"} %ld\n"
+               "gtthread_threads{state=\"joining\"} %ld\n"
+               "gtthread_threads{state=\"done\"} %ld\n"
+               "gtthread_threads{state=\"cancelled\"} %ld\n",
+            m.runnable, m.throttled, m.not_started, m.blocked, m.joining, m.done,
+            m.cancelled);
+    fprintf(f, "# HELP gtthread_zombies Terminated threads kept for gtthread_join.\n"
+               "# TYPE gtthread_zombies gauge\n"
+               "gtthread_zombies %ld\n", m.done + m.cancelled);
+    fprintf(f, "# HELP gtthread_stack_bytes Memory held by thread stacks.\n"
+               "# TYPE gtthread_stack_bytes gauge\n"
+               "gtthread_stack_bytes %zu\n", m.stack_bytes);
+
+    fprintf(f, "# HELP gtthread_mutex_waiters Threads waiting on each mutex that has any.\n"
+               "# TYPE gtthread_mutex_waiters gauge\n");
+    for (i = 0; i < m.nmutexes; i++)
+        fprintf(f, "gtthread_mutex_waiters{mutex=\"%p\"} %ld\n",
+                (void*) m.mutexes[i].mutex, m.mutexes[i].waiters);
+
+#if GTTHREAD_ENABLE_LOCKPROF
+    /* the lock profile has the history, for the mutexes waited on longest */
+    if ((rows = lockprof_sorted(&nrows)) != NULL)
+    {
+        if (nrows > METRICS_MUTEXES)
+            nrows = METRICS_MUTEXES;
+        fprintf(f, "# HELP gtthread_mutex_contended_total Acquisitions that had to wait, for the most waited for mutexes.\n"
+                   "# TYPE gtthread_mutex_contended_total counter\n");
+        for (j = 0; j < nrows; j++)
+            fprintf(f, "gtthread_mutex_contended_total{mutex=\"%p\"} %lu\n",
+                    (void*) rows[j].mutex, rows[j].contended);
+        fprintf(f, "# HELP gtthread_mutex_wait_seconds_total Time spent waiting, for the most waited for mutexes.\n"
+                   "# TYPE gtthread_mutex_wait_seconds_total counter\n");
+        for (j = 0; j < nrows; j++)
+            fprintf(f, "gtthread_mutex_wait_seconds_total{mutex=\"%p\"} %.6f\n",
+                    (void*) rows[j].mutex, rows[j].wait_ticks / rate);
+        free(rows);
+    }
+#endif
+
+#if GTTHREAD_ENABLE_LATENCY
+    fprintf(f, "# HELP gtthread_ready_latency_seconds Delay from ready to running, by why the thread became ready.\n"
+               "# TYPE gtthread_ready_latency_seconds summary\n");
+    for (i = 0; i < GTTHREAD_LATENCY_CLASSES; i++)
+    {
+        gtthread_latency_t l;
+
+        if (gtthread_getlatency(i, &l) < 0)
+            continue;
+        fprintf(f, "gtthread_ready_latency_seconds{class=\"%s\",quantile=\"0.5\"} %.9f\n"
+                   "gtthread_ready_latency_seconds{class=\"%s\",quantile=\"0.9\"} %.9f\n"
+                   "gtthread_ready_latency_seconds{class=\"%s\",quantile=\"0.99\"} %.9f\n"
+                   "gtthread_ready_latency_seconds{class=\"%s\",quantile=\"0.999\"} %.9f\n"
+                   "gtthread_ready_latency_seconds_sum{class=\"%s\"} %.9f\n"
+                   "gtthread_ready_latency_seconds_count{class=\"%s\"} %llu\n",
+                latency_name(i), l.p50_ns / 1e9, latency_name(i), l.p90_ns / 1e9,
+                latency_name(i), l.p99_ns / 1e9, latency_name(i), l.p999_ns / 1e9,
+                latency_name(i), l.total_ns / 1e9, latency_name(i), l.count);
+    }
+#endif
+
+    if (fclose(f) != 0)
+    {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+/* sorts a thread into the counts; SIGVTALRM is blocked */
+static void metrics_collect(thread_t* t, void* arg)
+{
+    metrics_t* m = (metrics_t*) arg;
+    int i;
+
+    m->stack_bytes += thread_stack_bytes(t);
+    if (t->state == GTTHREAD_DONE)
+        m->done++;
+    else if (t->state == GTTHREAD_CANCEL)
+        m->cancelled++;
+    else if (t == thread_current())
+        ;
+    else if (t->parked)
+        m->throttled++;
+    else if (t->waiting != NULL)
+    {
+        m->blocked++;
+        for (i = 0; i < m->nmutexes && m->mutexes[i].mutex != t->waiting; i++)
+            ;
+        if (i < m->nmutexes)
+            m->mutexes[i].waiters++;
+        else if (i < METRICS_MUTEXES)
+        {
+            m->mutexes[i].mutex = t->waiting;
+            m->mutexes[i].waiters = 1;
+            m->nmutexes++;
+        }
+    }
+    else if (t->joining != 0)
+        m->joining++;
+    else if (t->ucp == NULL)
+        m->not_started++;
+    else
+        m->runnable++;
+}
+
+static int metrics_cmp(const void* a, const void* b)
+{
+    long x = ((const metrics_mutex_t*) a)->waiters;
+    long y = ((const metrics_mutex_t*) b)->waiters;
+
+    return (x < y) - (x > y);
+}
+
+static uint64_t metrics_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
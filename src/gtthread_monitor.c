@@ -0,0 +1,147 @@
+/**********************************************************************
+gtthread_monitor.c.
+
+This file contains the preemption monitor, a kernel thread in the
+manner of Go's sysmon. While it runs, the preemption timer is off and
+threads only switch when they yield, wait or exit. The monitor wakes
+up a few times per limit and reads the scheduler's switch count; if it
+has not moved for a whole limit while other threads are queued, the
+running thread is hogging the processor. The monitor then raises
+gtthread_preempt_requested, which a loop polling gtthread_check_preempt
+acts on at its next iteration; if the thread still has not switched a
+limit later, and the program takes signals at all, the monitor sends
+SIGVTALRM to the gtthreads' kernel thread to preempt it. The monitor
+replaces the timer rather than adding to it: no quantum is armed while
+it runs, not even one set with gtthread_set_quantum. Cooperative
+programs thus take no ticks at all, while a thread that never yields
+still runs for at most about two limits at a time.
+
+The monitor only reads the counters the scheduler keeps; they have a
+single writer, so a stale value merely delays or wastes one signal.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+/* checks per limit */
+#define MONITOR_CHECKS 4
+#define MONITOR_MIN_SLEEP_US 50
+
+static pthread_t monitor_thread;
+static pthread_t monitor_target;    /* the kernel thread running gtthreads */
+static int monitor_running;
+static volatile int monitor_stopping;
+static long monitor_limit;
+
+static void* monitor_run(void* arg);
+static uint64_t monitor_us(void);
+
+/*
+  Turns the preemption timer off and starts the monitor, which preempts
+  a thread once it has run for 'limit' microseconds while others wait.
+  The timer stays off while the monitor runs, also for threads with a
+  quantum of their own; their quantum is kept for when it stops.
+  Returns -1 if limit is not positive, the monitor is already running or
+  its thread cannot be created.
+ */
+int gtthread_monitor_start(long limit)
+{
+    sigset_t all, old;
+    int err;
+
+    if (limit <= 0 || monitor_running)
+    {
+        errno = limit <= 0 ? EINVAL : EBUSY;
+        return -1;
+    }
+    monitor_target = pthread_self();
+    monitor_limit = limit;
+    monitor_stopping = 0;
+
+    /* the monitor must never take the signals meant for the gtthreads */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    err = pthread_create(&monitor_thread, NULL, monitor_run, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0)
+    {
+        errno = err;
+        return -1;
+    }
+    monitor_running = 1;
+
+    VTALRM_BLOCK();
+    sched_monitored = 1;
+    timer_arm(0);
+    VTALRM_UNBLOCK();
+    return 0;
+}
+
+/*
+  Stops the monitor and turns the preemption timer back on, with the
+  running thread's own quantum if it has one.
+ */
+void gtthread_monitor_stop(void)
+{
+    if (!monitor_running)
+        return;
+    monitor_stopping = 1;
+    pthread_join(monitor_thread, NULL);
+    monitor_running = 0;
+
+    VTALRM_BLOCK();
+    sched_monitored = 0;
+    if (thread_current()->quantum != 0)
+        timer_arm(thread_current()->quantum);
+    else
+        timer_arm(sched_period);
+    VTALRM_UNBLOCK();
+}
+
+static void* monitor_run(void* arg)
+{
+    struct timespec nap;
+    long sleep_us = monitor_limit / MONITOR_CHECKS;
+    unsigned long gen, last = __atomic_load_n(&sched_switches, __ATOMIC_RELAXED);
+    uint64_t since = monitor_us(), now;
+
+    if (sleep_us < MONITOR_MIN_SLEEP_US)
+        sleep_us = MONITOR_MIN_SLEEP_US;
+    nap.tv_sec = sleep_us / 1000000;
+    nap.tv_nsec = sleep_us % 1000000 * 1000;
+
+    while (!monitor_stopping)
+    {
+        nanosleep(&nap, NULL);
+        now = monitor_us();
+        gen = __atomic_load_n(&sched_switches, __ATOMIC_RELAXED);
+        if (gen != last)
+        {
+            last = gen;
+            since = now;
+        }
+        else if (now - since >= (uint64_t) monitor_limit && thread_queued() > 0)
+        {
+            /* ask first; force only a thread that did not listen */
+            if (!gtthread_preempt_requested)
+                gtthread_preempt_requested = 1;
+            else if (__atomic_load_n(&sched_masking, __ATOMIC_RELAXED))
+                pthread_kill(monitor_target, SIGVTALRM);
+            since = now;
+        }
+    }
+    return NULL;
+}
+
+static uint64_t monitor_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
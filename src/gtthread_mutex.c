@@ -12,9 +12,9 @@ gtthreads library.  The locks can be implemented with a simple queue.
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <signal.h>
 #include "gtthread.h"
-
-extern sigset_t vtalrm;
+#include "gtthread_private.h"
 
 /*
   The gtthread_mutex_init() function is analogous to
@@ -24,43 +24,68 @@ extern sigset_t vtalrm;
  */
 int gtthread_mutex_init(gtthread_mutex_t* mutex)
 {
-    sigprocmask(SIG_BLOCK, &vtalrm, NULL); /* in case this is blocked previously */    
+    VTALRM_BLOCK(); /* in case this is blocked previously */    
     steque_init(mutex);
-    sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);
+    VTALRM_UNBLOCK();
     return 0;
 }
 
 /*
   The gtthread_mutex_lock() is analogous to pthread_mutex_lock.
-  Returns zero on success.
+  Returns zero on success. Waiting for the lock is a cancellation point;
+  a cancelled waiter leaves the queue without ever owning the lock.
  */
 int gtthread_mutex_lock(gtthread_mutex_t* mutex){
-    sigprocmask(SIG_BLOCK, &vtalrm, NULL); 
+#if GTTHREAD_ENABLE_LOCKPROF
+    uint64_t start;
+#endif
+    VTALRM_BLOCK(); 
 
     /* if queue lock is empty */
     if (steque_isempty(mutex))
     {
-        steque_enqueue(mutex, (steque_item) gtthread_self());  
-        sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);   
+        steque_enqueue(mutex, (steque_item) thread_current());  
+        TRACE(LOCK, gtthread_self(), mutex);
+#if GTTHREAD_ENABLE_LOCKPROF
+        lockprof_acquired(mutex, 0, 0);
+#endif
+        VTALRM_UNBLOCK();   
+        if (sched_deterministic)
+            replay_point();
         return 0;
     }
 
     /* if a thread try to acquire lock */ 
-    if (gtthread_self() == (gtthread_t) steque_front(mutex))
+    if (thread_current() == (thread_t*) steque_front(mutex))
     {
-        sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);
+        VTALRM_UNBLOCK();
         return 0;
     }
 
-    steque_enqueue(mutex, (steque_item) gtthread_self()); 
-    while (gtthread_self() != (gtthread_t) steque_front(mutex)) 
+    steque_enqueue(mutex, (steque_item) thread_current()); 
+    thread_current()->waiting = mutex;
+    TRACE(LOCK_WAIT, gtthread_self(), mutex);
+    PROBE2(mutex_wait, mutex, gtthread_self());
+#if GTTHREAD_ENABLE_LOCKPROF
+    start = clock_ticks();
+#endif
+    while (thread_current() != (thread_t*) steque_front(mutex)) 
     {
-        sigprocmask(SIG_UNBLOCK, &vtalrm, NULL); 
+        VTALRM_UNBLOCK(); 
         /* actively perform context switching */
-        sigvtalrm_handler(SIGVTALRM);
-        sigprocmask(SIG_BLOCK, &vtalrm, NULL);
+        sigvtalrm_handler(0);
+        gtthread_testcancel();
+        VTALRM_BLOCK();
     }
-    sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);  
+    thread_current()->waiting = NULL;
+    TRACE(LOCK, gtthread_self(), mutex);
+    PROBE2(mutex_acquire, mutex, gtthread_self());
+#if GTTHREAD_ENABLE_LOCKPROF
+    lockprof_acquired(mutex, 1, clock_ticks() - start);
+#endif
+    VTALRM_UNBLOCK();  
+    if (sched_deterministic)
+        replay_point();
     return 0; 
 }
 
@@ -69,21 +94,35 @@ int gtthread_mutex_lock(gtthread_mutex_t* mutex){
   Returns zero on success.
  */
 int gtthread_mutex_unlock(gtthread_mutex_t *mutex){
-    sigprocmask(SIG_BLOCK, &vtalrm, NULL);
+    VTALRM_BLOCK();
     if (steque_isempty(mutex))
     {
-        sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);
+        VTALRM_UNBLOCK();
         return -1;
     }
 
-    if ((gtthread_t) steque_front(mutex) != gtthread_self())
+    if ((thread_t*) steque_front(mutex) != thread_current())
     {
-       sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);
+       VTALRM_UNBLOCK();
        return -1;
     }
 
     steque_pop(mutex);
-    sigprocmask(SIG_UNBLOCK, &vtalrm, NULL); 
+    TRACE(UNLOCK, gtthread_self(), mutex);
+    PROBE2(mutex_release, mutex, gtthread_self());
+#if GTTHREAD_ENABLE_LOCKPROF
+    lockprof_released(mutex);
+#endif
+    if (!steque_isempty(mutex))
+    {
+        thread_t* t = (thread_t*) steque_front(mutex);
+
+        TRACE(WAKEUP, gtthread_self(), t->tid);
+        thread_wake(t);
+    }
+    VTALRM_UNBLOCK(); 
+    if (sched_deterministic)
+        replay_point();
     return 0; 
 }
 
@@ -92,8 +131,8 @@ int gtthread_mutex_unlock(gtthread_mutex_t *mutex){
   pthread_mutex_destroy and frees any resourcs associated with the mutex.
 */
 int gtthread_mutex_destroy(gtthread_mutex_t *mutex){
-    sigprocmask(SIG_BLOCK, &vtalrm, NULL); /* in case this is blocked previously */    
+    VTALRM_BLOCK(); /* in case this is blocked previously */    
     steque_destroy(mutex);
-    sigprocmask(SIG_UNBLOCK, &vtalrm, NULL); 
+    VTALRM_UNBLOCK(); 
     return 0; 
 }
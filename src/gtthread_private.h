@@ -0,0 +1,425 @@
+/*
+ *  gtthread_private.h
+ *  gtthread
+ *
+ *  Internal definitions shared by the gtthread source files. This header
+ *  is not copied into the include folder; programs only see gtthread.h.
+ */
+
+#ifndef __GTTHREAD_PRIVATE_H
+#define __GTTHREAD_PRIVATE_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "gtthread.h"
+#include "gtthread_config.h"
+#include "gtthread_sdt.h"
+#include "gtthread_trace.h"
+#include "steque.h"
+
+#define GTTHREAD_RUNNING 0 /* the thread is running */
+#define GTTHREAD_CANCEL 1 /* the thread is cancelled */
+#define GTTHREAD_DONE 2 /* the thread has done */
+
+/* switch with the code in gtthread_switch.c rather than swapcontext */
+#if defined(__x86_64__) && !GTTHREAD_UCONTEXT
+#define CTX_ASM 1
+#else
+#define CTX_ASM 0
+#endif
+
+/* a token bucket of CPU time, see gtthread_group.c */
+typedef struct
+{
+    int64_t tokens;             /* clock_ticks that may still be used */
+    int64_t size;               /* clock_ticks given per GTTHREAD_BUDGET_PERIOD
+                                   and the most held, 0 for no limit */
+    uint64_t stamp;             /* when it was last filled */
+} budget_t;
+
+/* a thread's control block; its stack and context are in a slot set up
+ * when it is first dispatched, see thread_prepare, so this is all that a
+ * thread which has not run yet costs: 200 bytes on x86-64, 272 with
+ * GTTHREAD_ENABLE_STATS and GTTHREAD_ENABLE_LATENCY */
+typedef struct Thread_t
+{
+    gtthread_t tid;
+    gtthread_t joining;
+    gtthread_t joiner;          /* the last thread to wait in gtthread_join
+                                   for it, run next when it exits */
+    int state;
+    void* (*proc)(void*);
+    void* arg;
+    void* retval;
+    ucontext_t* ucp;            /* its stack, and with CTX_ASM nothing else */
+    void* sp;                   /* saved stack pointer, with CTX_ASM */
+    struct Thread_t* rq_next;   /* neighbours in the ready queue */
+    struct Thread_t* rq_prev;
+    unsigned long rq_due;       /* the dispatch round robin would run it by */
+    struct Batch_t* batch;      /* allocation shared with gtthread_create_n
+                                   siblings, NULL if the thread owns it */
+    struct Group_t* group;      /* whose share it runs on, NULL once it has
+                                   terminated */
+    budget_t budget;            /* see gtthread_set_cpu_budget */
+    int parked;                 /* out of the ready queue until its budget
+                                   has come back */
+
+    /* cancellation */
+    int cancel_state;           /* GTTHREAD_CANCEL_ENABLE or _DISABLE */
+    int cancel_type;            /* GTTHREAD_CANCEL_ASYNCHRONOUS or _DEFERRED */
+    int cancel_pending;         /* gtthread_cancel has been called on it */
+    steque_t cleanup;           /* cleanup handlers, most recent at front */
+    gtthread_mutex_t* waiting;  /* mutex the thread is queued on, if any */
+    int daemon;                 /* does not keep the program alive */
+    long quantum;               /* own preemption period, 0 for the default */
+
+#if GTTHREAD_ENABLE_LATENCY
+    uint64_t ready_at;          /* when it last became ready to run */
+    int ready_class;            /* why, -1 if it is not waiting to run */
+#endif
+
+#if GTTHREAD_ENABLE_STATS
+    /* statistics, in clock_ticks; see gtthread_getstats */
+    uint64_t since;             /* last switch to or away from the thread */
+    uint64_t run_ticks;
+    uint64_t wait_ticks;
+    uint64_t blocked_ticks;
+    unsigned long nvcsw;        /* voluntary switches away */
+    unsigned long nivcsw;       /* switches away on a tick */
+    unsigned long npreempt;     /* ticks taken */
+#endif
+} thread_t;
+
+/* a ready queue, linked through the threads themselves so that any of
+ * them can be taken out at once */
+typedef struct
+{
+    thread_t* front;
+    thread_t* back;
+    long n;
+    unsigned long dispatched;   /* threads taken out to run */
+} runq_t;
+
+/* a group of threads sharing the CPU, see gtthread_group.c */
+typedef struct Group_t
+{
+    runq_t queue;               /* its threads ready to run */
+    unsigned long weight;
+    budget_t cap;               /* its cap of the CPU, if it has one */
+    long members;               /* live threads in it */
+    uint64_t vruntime;          /* CPU time used, in clock_ticks, scaled
+                                   by GTTHREAD_GROUP_WEIGHT / weight */
+    struct Group_t* next;       /* the next group created */
+} group_t;
+
+/* SIGVTALRM mask, defined in gtthread_sched.c; blocked while the queues
+ * are being changed, it also holds the dump signal, see gtthread_dump.c */
+extern sigset_t vtalrm;
+
+/* the scheduler masks vtalrm in its critical sections; off while the
+ * threads run cooperatively, see signals_enable */
+extern int sched_masking;
+
+/* turns on the SIGVTALRM handler and the masking, for a timer or the
+ * dump signal; called with vtalrm blocked as far as it is, it returns
+ * with it blocked. Returns -1 if the handler cannot be installed */
+int signals_enable(void);
+
+/* enter and leave a critical section of the scheduler */
+#if GTTHREAD_COOPERATIVE
+#define VTALRM_BLOCK()      ((void) 0)
+#define VTALRM_UNBLOCK()    ((void) 0)
+#else
+#define VTALRM_BLOCK() \
+    (sched_masking ? (void) sigprocmask(SIG_BLOCK, &vtalrm, NULL) : (void) 0)
+#define VTALRM_UNBLOCK() \
+    (sched_masking ? (void) sigprocmask(SIG_UNBLOCK, &vtalrm, NULL) : (void) 0)
+#endif
+
+/* the context switch, see gtthread_switch.c; ctx_init sets up the
+ * first switch to a thread whose stack is in its context, ctx_switch
+ * saves the running thread in prev and resumes next, and ctx_jump
+ * resumes next from a thread that has exited */
+#if CTX_ASM
+void ctx_setup(void);
+void ctx_init(thread_t* t);
+void ctx_swap(void** from, void* to);
+void ctx_jump(thread_t* next);
+
+/* where a suspended thread resumes and its frame pointer there */
+void ctx_frame(thread_t* t, void** pc, uintptr_t** fp);
+
+static inline void ctx_switch(thread_t* prev, thread_t* next)
+{
+    ctx_swap(&prev->sp, next->sp);
+}
+#else
+static inline void ctx_switch(thread_t* prev, thread_t* next)
+{
+    swapcontext(prev->ucp, next->ucp);
+}
+
+static inline void ctx_jump(thread_t* next)
+{
+    setcontext(next->ucp);
+}
+#endif
+
+/* switches, and those on a tick, since gtthread_init */
+extern unsigned long sched_switches;
+extern unsigned long sched_preemptions;
+
+/* dispatches given to a starving thread ahead of the one picked */
+extern unsigned long sched_starvations;
+
+/* the preemption period of threads without their own, in microseconds */
+extern long sched_period;
+
+/* sets sched_period, and starts a new quantum if the running thread goes
+ * by it; returns -1 if the timer cannot be set */
+int timer_set(long period);
+
+/* starts a quantum of the given length; returns -1 if the timer cannot
+ * be set */
+int timer_arm(long period);
+
+/* the monitor runs, see gtthread_monitor.c; no quantum is armed then,
+ * not even a thread's own */
+extern int sched_monitored;
+
+/* the adaptive quantum is on, see gtthread_quantum.c */
+extern int quantum_adaptive;
+
+/* feed a tick, and the resumption of the thread it switched to, to the
+ * adaptive quantum; SIGVTALRM must be blocked for quantum_tick */
+void quantum_tick(void);
+void quantum_resumed(void);
+
+/* returns the control block of the running thread */
+thread_t* thread_current(void);
+
+/* the number of threads in the ready queue, including those that poll
+ * a mutex or a join there; exact with SIGVTALRM blocked, a hint
+ * otherwise, as for the monitor's kernel thread */
+long thread_queued(void);
+
+/* has a thread that a mutex was handed to run at the next voluntary
+ * switch, see gtthread_sched.c; SIGVTALRM must be blocked */
+void thread_wake(thread_t* t);
+
+/* is a thread waiting on a mutex or a join that it cannot take yet;
+ * SIGVTALRM must be blocked */
+int thread_blocked(thread_t* t);
+
+/* finds a created thread by its ID, NULL if there is none */
+thread_t* thread_get(gtthread_t tid);
+
+/* calls fn on every thread, running, runnable or terminated, in no
+ * particular order; SIGVTALRM must be blocked */
+void thread_foreach(void (*fn)(thread_t*, void*), void* arg);
+
+/* marks a thread as a daemon, see gtthread_sched.c; SIGVTALRM must be
+ * blocked */
+void thread_daemon(thread_t* t);
+
+/* bytes of stack a thread holds; SIGVTALRM must be blocked */
+size_t thread_stack_bytes(thread_t* t);
+
+#if GTTHREAD_ENABLE_STATS
+/* converts the counts of a thread, adding the time since its last switch
+ * to whichever state it is in at 'now'; SIGVTALRM must be blocked */
+void thread_stats(thread_t* t, gtthread_stats_t* out, uint64_t now);
+#endif
+
+/* the group of the threads in none, and the number of groups including
+ * it; while it is the only one the scheduler runs plain round robin */
+extern group_t group_default;
+extern int group_count;
+
+/* the live threads with a CPU budget, see gtthread_set_cpu_budget */
+extern long budget_threads;
+
+/* the scheduler charges the CPU time used to threads and groups, reading
+ * the clock on every switch, while there are groups or budgets */
+static inline int sched_charging(void)
+{
+    return group_count > 1 || budget_threads > 0;
+}
+
+/* picks the group to run a thread of next: the one that has used the
+ * least of its share, among those with threads ready and under their cap,
+ * after putting back the parked threads whose budget has come back.
+ * prev is the running thread if it can go on running, NULL otherwise.
+ * Returns NULL if prev should go on; idles while every thread that could
+ * run is over its budget or in a group over its cap. SIGVTALRM must be
+ * blocked */
+group_t* group_pick(thread_t* prev);
+
+/* does group g get to run ahead of the pick, for a woken thread or a
+ * directed yield: it is under its cap and not ahead of the others by
+ * more than a slice. SIGVTALRM must be blocked */
+int group_admits(group_t* g);
+
+/* has a group that had no thread ready catch up with the others */
+void group_wake(group_t* g);
+
+/* moves a live thread into group g; SIGVTALRM must be blocked */
+void thread_regroup(thread_t* t, group_t* g);
+
+/* when a bucket filled up to 'now' has tokens again, 'now' if it has */
+uint64_t budget_due(budget_t* b, uint64_t now);
+
+/* puts the parked threads whose budget has come back by 'now', or that
+ * have none any more, back in the ready queue; returns when the first of
+ * those left does, UINT64_MAX if none are. SIGVTALRM must be blocked */
+uint64_t thread_unpark(uint64_t now);
+
+/* starts the profiler if GTTHREAD_PROF is set */
+void prof_from_env(void);
+
+/* the deterministic mode is on, see gtthread_replay.c; the scheduler
+ * then leaves gtthread_preempt_requested set and no timer runs */
+extern int sched_deterministic;
+
+/* starts the deterministic mode if GTTHREAD_SEED or GTTHREAD_REPLAY is set */
+void replay_from_env(void);
+
+/* counts a safepoint in the deterministic mode, preempting the running
+ * thread when it is due */
+void replay_point(void);
+
+/* records a switch, or checks it against the replay; SIGVTALRM must be
+ * blocked */
+void replay_switch(thread_t* prev, thread_t* next, int voluntary);
+
+/* the thread the replay switches to next if it is ready, NULL otherwise;
+ * SIGVTALRM must be blocked */
+thread_t* replay_next(void);
+
+/* the timestamp counter where there is one, nanoseconds otherwise */
+static inline uint64_t clock_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* the rate of clock_ticks, measured on first use */
+double clock_ticks_per_us(void);
+
+#if GTTHREAD_ENABLE_TRACE
+/* trace file mapped by gtthread_trace_start, NULL while tracing is off */
+extern gtthread_trace_header_t* trace_file;
+
+/* appends an event to the trace; SIGVTALRM must be blocked */
+void trace_record(uint32_t type, gtthread_t tid, uint64_t arg);
+
+/* records a GTTHREAD_TRACE_<type> event if tracing is on */
+#define TRACE(type, tid, arg) \
+    do { \
+        if (trace_file != NULL) \
+            trace_record(GTTHREAD_TRACE_##type, (tid), (uint64_t) (arg)); \
+    } while (0)
+#else
+#define TRACE(type, tid, arg) do { } while (0)
+#endif
+
+#if GTTHREAD_ENABLE_LOCKPROF
+/* the counts kept for a mutex, in clock_ticks */
+typedef struct
+{
+    gtthread_mutex_t* mutex;    /* NULL for a free slot */
+    unsigned long acquired;
+    unsigned long contended;
+    uint64_t wait_ticks;
+    uint64_t max_wait;
+    uint64_t hold_ticks;
+    uint64_t max_hold;
+    uint64_t since;             /* when it was last acquired */
+} lockprof_t;
+
+/* returns a malloc'ed copy of the counts of the n mutexes locked so far,
+ * the most waited for first; NULL if out of memory */
+lockprof_t* lockprof_sorted(size_t* n);
+
+/* account an acquisition of mutex, after waiting 'wait' clock_ticks if
+ * it was contended, and its release; SIGVTALRM must be blocked */
+void lockprof_acquired(gtthread_mutex_t* mutex, int contended, uint64_t wait);
+void lockprof_released(gtthread_mutex_t* mutex);
+#endif
+
+/* a log-linear histogram of clock_ticks, see gtthread_hist.c */
+#define HIST_BITS 5
+#define HIST_SUB (1 << HIST_BITS)
+#define HIST_BUCKETS ((64 - HIST_BITS + 1) * HIST_SUB)
+
+typedef struct
+{
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t n;
+    uint64_t total;
+    uint64_t max;
+} hist_t;
+
+/* adds a value to a histogram */
+void hist_record(hist_t* h, uint64_t ticks);
+
+/* the value below which the given fraction of those recorded lie, to
+ * the precision of the buckets and at most the largest seen */
+uint64_t hist_at(const hist_t* h, double fraction);
+
+#if GTTHREAD_ENABLE_LATENCY
+/* adds a delay of 'ticks' to the histogram of class cls; SIGVTALRM must
+ * be blocked */
+void latency_record(int cls, uint64_t ticks);
+
+/* the name of class cls */
+const char* latency_name(int cls);
+
+/* marks thread t as ready to run for reason GTTHREAD_LATENCY_<cls> */
+#define LATENCY_READY(t, cls) \
+    do { \
+        (t)->ready_at = clock_ticks(); \
+        (t)->ready_class = GTTHREAD_LATENCY_##cls; \
+    } while (0)
+
+/* records how long thread t waited to run, as it is dispatched */
+#define LATENCY_RUN(t) \
+    do { \
+        if ((t)->ready_class >= 0) \
+        { \
+            latency_record((t)->ready_class, clock_ticks() - (t)->ready_at); \
+            (t)->ready_class = -1; \
+        } \
+    } while (0)
+#else
+#define LATENCY_READY(t, cls) do { } while (0)
+#define LATENCY_RUN(t) do { } while (0)
+#endif
+
+#if GTTHREAD_ENABLE_TICKSTATS
+/* starts the tick diagnostics for the quantum given to gtthread_init */
+void ticks_start(long period);
+
+/* stamp the entry to a switch, for SIGVTALRM or a voluntary one (sig 0),
+ * and its end in the thread that runs next */
+void ticks_enter(int sig);
+void ticks_leave(void);
+
+#define TICKS_ENTER(sig) ticks_enter(sig)
+#define TICKS_LEAVE() ticks_leave()
+#else
+#define TICKS_ENTER(sig) do { } while (0)
+#define TICKS_LEAVE() do { } while (0)
+#endif
+
+#endif // __GTTHREAD_PRIVATE_H
@@ -0,0 +1,343 @@
+/**********************************************************************
+gtthread_prof.c.
+
+This file contains the sampling profiler. perf and gprof only see the
+kernel thread, so all gtthreads blur into one stack; here each sample
+also records which gtthread was running. Samples are taken on the
+preemption tick or on a separate ITIMER_PROF timer, into a buffer
+allocated up front, and written out as folded stacks for flame graphs.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <execinfo.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+#define PROF_DEPTH 32
+#define PROF_DEFAULT_SAMPLES 65536
+/* prof_record, the signal handler and the signal trampoline */
+#define PROF_SKIP 3
+
+typedef struct
+{
+    gtthread_t tid;
+    void* proc;             /* start routine, NULL for the main thread */
+    int depth;
+    void* pcs[PROF_DEPTH];  /* innermost first */
+} prof_sample_t;
+
+static prof_sample_t* prof_samples;
+static long prof_cap;
+static volatile long prof_count;
+static long prof_dropped;
+static int prof_timer;     /* sampling on ITIMER_PROF */
+static int prof_tick;      /* sampling on the preemption tick */
+static const char* prof_path;
+/* the dispositions the profiler's handlers replaced */
+static struct sigaction prof_saved_vtalrm;
+static struct sigaction prof_saved_prof;
+
+static void prof_record(void);
+static void prof_handler(int sig);
+static void prof_tick_handler(int sig);
+static void prof_atexit(void);
+static char* prof_name(char* symbol, char* buf, size_t size);
+static int prof_cmp(const void* a, const void* b);
+
+/*
+  Starts sampling. With period 0, a sample is taken on every preemption
+  tick; otherwise an ITIMER_PROF timer takes one every 'period'
+  microseconds of CPU time. At most nsamples are kept, 0 meaning the
+  default. Samples from an earlier run are discarded. Returns -1 if the
+  buffer or the timer cannot be set up, with errno EINVAL if period is 0
+  but there is no tick: the threads run cooperatively, under the monitor
+  or deterministically. SIGPROF is masked with SIGVTALRM while the timer
+  runs, so a sample never lands half way through a switch; the
+  cooperative-only build has no masking, and fails with ENOSYS.
+ */
+int gtthread_prof_start(long period, long nsamples)
+{
+    struct sigaction act;
+    struct itimerval timer;
+    void* pc;
+
+    gtthread_prof_stop();
+    if (period == 0 && (sched_period == 0 || sched_monitored || sched_deterministic))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (nsamples <= 0)
+        nsamples = PROF_DEFAULT_SAMPLES;
+
+    /* backtrace loads libgcc on first use, which must not happen in a
+     * signal handler */
+    backtrace(&pc, 1);
+
+    VTALRM_BLOCK();
+    free(prof_samples);
+    prof_samples = (prof_sample_t*) malloc(nsamples * sizeof(prof_sample_t));
+    prof_cap = prof_samples != NULL ? nsamples : 0;
+    prof_count = 0;
+    prof_dropped = 0;
+    VTALRM_UNBLOCK();
+    if (prof_samples == NULL)
+        return -1;
+
+    /* on the tick, the scheduler's handler is wrapped for as long as the
+     * profiler runs, so it costs nothing otherwise */
+    memset(&act, '\0', sizeof(act));
+    act.sa_handler = period == 0 ? &prof_tick_handler : &prof_handler;
+    act.sa_flags = SA_RESTART;
+    act.sa_mask = vtalrm;
+    if (period == 0)
+    {
+        if (sigaction(SIGVTALRM, &act, &prof_saved_vtalrm) < 0)
+            return -1;
+        prof_tick = 1;
+        return 0;
+    }
+    VTALRM_BLOCK();
+    if (signals_enable() < 0)
+    {
+        VTALRM_UNBLOCK();
+        return -1;
+    }
+    sigaddset(&act.sa_mask, SIGPROF);
+    if (sigaction(SIGPROF, &act, &prof_saved_prof) < 0)
+    {
+        VTALRM_UNBLOCK();
+        return -1;
+    }
+    sigaddset(&vtalrm, SIGPROF);
+
+    timer.it_interval.tv_sec = period / 1000000;
+    timer.it_interval.tv_usec = period % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, NULL) < 0)
+    {
+        sigaction(SIGPROF, &prof_saved_prof, NULL);
+        VTALRM_UNBLOCK();
+        sigdelset(&vtalrm, SIGPROF);
+        return -1;
+    }
+    prof_timer = 1;
+    VTALRM_UNBLOCK();
+    return 0;
+}
+
+/*
+  Stops sampling. The samples taken are kept for gtthread_prof_write.
+  The signal handlers go back to what they were when sampling started.
+ */
+void gtthread_prof_stop(void)
+{
+    struct itimerval timer;
+
+    if (prof_tick)
+    {
+        sigaction(SIGVTALRM, &prof_saved_vtalrm, NULL);
+        prof_tick = 0;
+    }
+    if (prof_timer)
+    {
+        /* ignoring SIGPROF discards one still pending, which the old
+         * disposition might not survive */
+        VTALRM_BLOCK();
+        memset(&timer, '\0', sizeof(timer));
+        setitimer(ITIMER_PROF, &timer, NULL);
+        signal(SIGPROF, SIG_IGN);
+        sigaction(SIGPROF, &prof_saved_prof, NULL);
+        prof_timer = 0;
+        VTALRM_UNBLOCK();
+        sigdelset(&vtalrm, SIGPROF);
+    }
+}
+
+/*
+  Writes the samples to fd as folded stacks, one line per distinct stack
+  with its count. Each stack starts with the start routine of the thread
+  and the thread ID, so a flame graph groups first by routine and then by
+  thread. Stacks that cannot be named for lack of memory are left out.
+ */
+void gtthread_prof_write(int fd)
+{
+    char** lines;
+    char** symbols;
+    char name[128];
+    prof_sample_t* s;
+    long n, i, j, len;
+    void* pcs[PROF_DEPTH + 1];
+
+    n = prof_count;
+    lines = (char**) malloc(n * sizeof(char*));
+    if (lines == NULL && n > 0)
+        return;
+
+    for (i = 0; i < n; i++)
+    {
+        s = &prof_samples[i];
+
+        /* a return address can point past a call that never returns, so
+         * look up the byte before it instead */
+        pcs[0] = s->proc;
+        for (j = 0; j < s->depth; j++)
+            pcs[j + 1] = j == 0 ? s->pcs[j] : (char*) s->pcs[j] - 1;
+        symbols = backtrace_symbols(pcs, s->depth + 1);
+        if (symbols == NULL)
+        {
+            lines[i] = NULL;
+            continue;
+        }
+
+        len = 64;
+        for (j = 0; j <= s->depth; j++)
+            len += strlen(symbols[j]) + 1;
+        lines[i] = (char*) malloc(len);
+        if (lines[i] == NULL)
+        {
+            free(symbols);
+            continue;
+        }
+        snprintf(lines[i], len, "%s;gtthread %lu",
+                 s->proc != NULL ? prof_name(symbols[0], name, sizeof(name)) : "main",
+                 s->tid);
+        for (j = s->depth; j > 0; j--)
+        {
+            strcat(lines[i], ";");
+            strcat(lines[i], prof_name(symbols[j], name, sizeof(name)));
+        }
+        free(symbols);
+    }
+
+    qsort(lines, n, sizeof(char*), prof_cmp);
+    for (i = 0; i < n; i = j)
+    {
+        for (j = i + 1; j < n && lines[j] != NULL && lines[i] != NULL
+             && strcmp(lines[i], lines[j]) == 0; j++)
+            ;
+        if (lines[i] != NULL)
+            dprintf(fd, "%s %ld\n", lines[i], j - i);
+    }
+    if (prof_dropped > 0)
+        dprintf(fd, "[dropped] %ld\n", prof_dropped);
+
+    for (i = 0; i < n; i++)
+        free(lines[i]);
+    free(lines);
+}
+
+/*
+ * Records the running thread and its stack. Called from signal handlers
+ * with SIGVTALRM blocked; it must not be inlined, so that the frames to
+ * skip are always the same.
+ */
+__attribute__((noinline)) static void prof_record(void)
+{
+    thread_t* t = thread_current();
+    prof_sample_t* s;
+    void* pcs[PROF_DEPTH + PROF_SKIP];
+    int n;
+
+    if (prof_count >= prof_cap)
+    {
+        prof_dropped++;
+        return;
+    }
+    s = &prof_samples[prof_count];
+    n = backtrace(pcs, PROF_DEPTH + PROF_SKIP) - PROF_SKIP;
+    s->depth = n > 0 ? n : 0;
+    memcpy(s->pcs, pcs + PROF_SKIP, s->depth * sizeof(void*));
+    s->tid = t->tid;
+    s->proc = t->tid == 1 ? NULL : (void*) t->proc;
+    prof_count++;
+}
+
+/*
+ * Starts the profiler if GTTHREAD_PROF names a file, writing the samples
+ * there when the program exits. Called by gtthread_init.
+ */
+void prof_from_env(void)
+{
+    prof_path = getenv("GTTHREAD_PROF");
+    if (prof_path == NULL || *prof_path == '\0')
+        return;
+    if (gtthread_prof_start(1000, 0) < 0)
+        perror("gtthread_prof_start");
+    else
+        atexit(prof_atexit);
+}
+
+static void prof_handler(int sig)
+{
+    prof_record();
+}
+
+static void prof_tick_handler(int sig)
+{
+    prof_record();
+    sigvtalrm_handler(sig);
+}
+
+static void prof_atexit(void)
+{
+    int fd;
+
+    gtthread_prof_stop();
+    fd = open(prof_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror(prof_path);
+        return;
+    }
+    gtthread_prof_write(fd);
+    close(fd);
+}
+
+/*
+ * Turns a line of backtrace_symbols, "module(function+0x1f) [0x...]",
+ * into the function name, or module+offset if the symbol is not exported.
+ */
+static char* prof_name(char* symbol, char* buf, size_t size)
+{
+    char* open = strchr(symbol, '(');
+    char* plus = open != NULL ? strchr(open, '+') : NULL;
+    char* close = open != NULL ? strchr(open, ')') : NULL;
+    char* base;
+
+    if (open == NULL || close == NULL)
+    {
+        snprintf(buf, size, "%s", symbol);
+        return buf;
+    }
+    if (plus != NULL && plus > open + 1 && plus < close)
+    {
+        snprintf(buf, size, "%.*s", (int) (plus - open - 1), open + 1);
+        return buf;
+    }
+
+    /* no name: keep the module's file name and the offset */
+    *open = '\0';
+    base = strrchr(symbol, '/');
+    snprintf(buf, size, "%s%.*s", base != NULL ? base + 1 : symbol,
+             (int) (close - open - 1), open + 1);
+    *open = '(';
+    return buf;
+}
+
+static int prof_cmp(const void* a, const void* b)
+{
+    const char* x = *(char* const*) a;
+    const char* y = *(char* const*) b;
+
+    if (x == NULL || y == NULL)
+        return (x != NULL) - (y != NULL);
+    return strcmp(x, y);
+}
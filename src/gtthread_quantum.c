@@ -0,0 +1,212 @@
+/**********************************************************************
+gtthread_quantum.c.
+
+This file contains the control of the preemption period. A thread can
+have a quantum of its own, set with gtthread_set_quantum, which the
+scheduler arms whenever it dispatches that thread; the others share the
+default period. Once gtthread_adapt_quantum has set bounds, that default
+is retuned every QUANTUM_WINDOW ticks from what the ticks have seen
+since the last time:
+
+ - if no other thread was ready to run, nobody waits on the quantum, so
+   it goes to the maximum;
+ - if nearly every switch came from a tick, the threads are batch work
+   that uses up its slices, so the quantum doubles to cut switches;
+ - otherwise threads that yield or block early are queued behind ones
+   that use whole slices, so the quantum halves to let them run sooner,
+   unless the ticks already arrive further apart than asked, which
+   means the timer cannot go any faster.
+
+The quantum never drops below 100 times the measured cost of a switch
+after a tick, so the scheduler keeps to about 1% of the CPU.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+#define QUANTUM_WINDOW 8
+/* a window this much dominated by ticks is batch work */
+#define QUANTUM_BATCH 0.9
+/* the quantum is at least this many switch costs */
+#define QUANTUM_COST_RATIO 100
+
+int quantum_adaptive;
+static long quantum_min;
+static long quantum_max;
+static long quantum_base;           /* the period to go back to */
+
+/* the current window */
+static int quantum_ticks;
+static long quantum_queued;         /* ready threads, summed over ticks */
+static unsigned long quantum_switches;
+static uint64_t quantum_start;
+
+/* the tick being switched away from, see quantum_resumed */
+static uint64_t quantum_stamp;
+static unsigned long quantum_stamp_switches;
+static double quantum_cost;         /* average switch cost, microseconds */
+
+static void quantum_retune(uint64_t now);
+
+/*
+  Lets the scheduler tune the quantum between min and max microseconds.
+  Both 0 turn the tuning off and restore the period given to
+  gtthread_init. Returns -1 if the bounds are not 0 < min <= max, or
+  the library is built cooperative-only.
+ */
+int gtthread_adapt_quantum(long min, long max)
+{
+    VTALRM_BLOCK();
+    if (min == 0 && max == 0)
+    {
+        if (quantum_adaptive)
+        {
+            quantum_adaptive = 0;
+            timer_set(quantum_base);
+        }
+        VTALRM_UNBLOCK();
+        return 0;
+    }
+    if (min <= 0 || max < min)
+    {
+        VTALRM_UNBLOCK();
+        errno = EINVAL;
+        return -1;
+    }
+    if (signals_enable() < 0)
+    {
+        VTALRM_UNBLOCK();
+        return -1;
+    }
+
+    clock_ticks_per_us();
+    if (!quantum_adaptive)
+        quantum_base = sched_period;
+    quantum_min = min;
+    quantum_max = max;
+    quantum_ticks = 0;
+    quantum_queued = 0;
+    quantum_switches = sched_switches;
+    quantum_start = clock_ticks();
+    quantum_stamp = 0;
+    quantum_adaptive = 1;
+    if (sched_period < min || sched_period > max)
+        timer_set(sched_period < min ? min : max);
+    VTALRM_UNBLOCK();
+    return 0;
+}
+
+/*
+  Returns the preemption period of the threads without a quantum of
+  their own, in microseconds.
+ */
+long gtthread_get_quantum(void)
+{
+    return sched_period;
+}
+
+/*
+  Gives a thread a quantum of its own of 'usec' microseconds, 0 going
+  back to the default. The timer is re-armed with it whenever the thread
+  is dispatched, and at once if it is the running thread. Returns -1 if
+  there is no such live thread, usec is negative or the library is built
+  cooperative-only.
+ */
+int gtthread_set_quantum(gtthread_t thread, long usec)
+{
+    thread_t* t;
+
+    if (usec < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    VTALRM_BLOCK();
+    t = thread_current();
+    if (t->tid != thread)
+        t = thread_get(thread);
+    if (t == NULL || t->state != GTTHREAD_RUNNING)
+    {
+        VTALRM_UNBLOCK();
+        errno = ESRCH;
+        return -1;
+    }
+    if (usec != 0 && signals_enable() < 0)
+    {
+        VTALRM_UNBLOCK();
+        return -1;
+    }
+    t->quantum = usec;
+    if (t == thread_current())
+        timer_arm(usec != 0 ? usec : sched_period);
+    VTALRM_UNBLOCK();
+    return 0;
+}
+
+/*
+ * Counts a tick into the window, retuning at its end, and stamps it so
+ * the thread switched to can take the cost. Called by the handler with
+ * SIGVTALRM blocked.
+ */
+void quantum_tick(void)
+{
+    uint64_t now = clock_ticks();
+
+    quantum_stamp = now;
+    quantum_stamp_switches = sched_switches;
+    quantum_queued += thread_queued();
+    if (++quantum_ticks >= QUANTUM_WINDOW)
+        quantum_retune(now);
+}
+
+/*
+ * Takes the cost of the switch after the last tick, if the thread now
+ * resuming in the handler is the one that tick switched to.
+ */
+void quantum_resumed(void)
+{
+    uint64_t stamp = quantum_stamp;
+    double cost;
+
+    if (stamp == 0 || sched_switches != quantum_stamp_switches + 1)
+        return;
+    quantum_stamp = 0;
+    cost = (clock_ticks() - stamp) / clock_ticks_per_us();
+    quantum_cost = quantum_cost == 0 ? cost : (7 * quantum_cost + cost) / 8;
+}
+
+static void quantum_retune(uint64_t now)
+{
+    unsigned long switches = sched_switches - quantum_switches;
+    double interval = (now - quantum_start) / clock_ticks_per_us() / quantum_ticks;
+    double full = switches > 0 ? (double) quantum_ticks / switches : 1;
+    long floor = quantum_min;
+    long period = sched_period;
+
+    if (quantum_cost * QUANTUM_COST_RATIO > floor)
+        floor = (long) (quantum_cost * QUANTUM_COST_RATIO);
+    if (floor > quantum_max)
+        floor = quantum_max;
+
+    if (quantum_queued == 0)
+        period = quantum_max;
+    else if (full >= QUANTUM_BATCH)
+        period *= 2;
+    else if (interval < 2 * period)
+        period /= 2;
+
+    if (period < floor)
+        period = floor;
+    if (period > quantum_max)
+        period = quantum_max;
+    if (period != sched_period)
+        timer_set(period);
+
+    quantum_ticks = 0;
+    quantum_queued = 0;
+    quantum_switches = sched_switches;
+    quantum_start = now;
+}
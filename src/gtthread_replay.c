@@ -0,0 +1,274 @@
+/**********************************************************************
+gtthread_replay.c.
+
+This file contains the deterministic scheduling mode, which makes a run
+reproducible. SIGVTALRM comes whenever the kernel has counted out the
+quantum, so the instruction a thread is preempted at, and with it the
+interleaving a race or a slow path shows up in, changes from run to run.
+In this mode the timer is off and the running thread is preempted at
+safepoints instead: gtthread_check_preempt, and the way out of
+gtthread_mutex_lock and gtthread_mutex_unlock. It is preempted once a
+pseudo-random number of them have gone by, drawn from a seed between 1
+and twice the mean given. Which thread runs next only depends on the
+order of the calls made, so two runs with the same seed switch at the
+same points.
+
+Each switch can be recorded to a file, after a header with the seed and
+mean, as a line
+
+    <safepoints> <from> <to> <p|v>
+
+with the number of safepoints gone by, the threads switched between and
+whether it was a preemption or a voluntary switch. Replaying the file
+preempts at the recorded safepoints and switches to the recorded
+threads, so a slow interleaving can be run again under a profiler. The
+first switch that differs, e.g. once the program has changed, is
+reported on stderr; from there, as from the end of the recording, the
+run goes on as the seed would have it. Groups, CPU budgets and programs
+that wait on the time read the clock, so runs using them only replay as
+far as they happen to follow the recording.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+/* the mean safepoints between preemptions when started from GTTHREAD_SEED */
+#define REPLAY_MEAN 100
+
+int sched_deterministic;
+
+static uint64_t replay_state;       /* of the xorshift64* generator */
+static long replay_mean;
+static long replay_countdown;       /* safepoints left before a preemption */
+static unsigned long replay_points; /* safepoints gone by */
+static FILE* replay_record;         /* being recorded to, if any */
+static FILE* replay_log;            /* being replayed, if any */
+
+/* the next switch of the recording being replayed */
+static struct
+{
+    unsigned long points;
+    gtthread_t from;
+    gtthread_t to;
+    char kind;
+} replay_want;
+
+static void replay_begin(unsigned long seed, long mean);
+static long replay_draw(void);
+static void replay_read(void);
+
+/*
+  Turns the deterministic mode on, preempting the running thread after
+  a number of safepoints drawn from seed, mean on average, and records
+  each switch to the file at path unless it is NULL. Call it right after
+  gtthread_init for a run to be reproducible. Returns -1 if mean is less
+  than 1 or the file cannot be created.
+ */
+int gtthread_deterministic_start(unsigned long seed, long mean, const char* path)
+{
+    FILE* f = NULL;
+
+    if (mean < 1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (path != NULL && (f = fopen(path, "w")) == NULL)
+        return -1;
+
+    VTALRM_BLOCK();
+    if (f != NULL)
+    {
+        /* a line at a time, so that a run that crashes is recorded */
+        setvbuf(f, NULL, _IOLBF, 0);
+        fprintf(f, "gtthread schedule seed %lu mean %ld\n", seed, mean);
+    }
+    replay_record = f;
+    replay_begin(seed, mean);
+    VTALRM_UNBLOCK();
+    return 0;
+}
+
+/*
+  Turns the deterministic mode on with the seed and mean of the file at
+  path, recorded by gtthread_deterministic_start, and follows the
+  switches recorded there. Call it at the same point of the program as
+  the recording was started. Returns -1 if the file cannot be read or
+  is not a recording.
+ */
+int gtthread_replay_start(const char* path)
+{
+    unsigned long seed;
+    long mean;
+    FILE* f;
+
+    if ((f = fopen(path, "r")) == NULL)
+        return -1;
+    if (fscanf(f, "gtthread schedule seed %lu mean %ld\n", &seed, &mean) != 2
+        || mean < 1)
+    {
+        fclose(f);
+        errno = EINVAL;
+        return -1;
+    }
+
+    VTALRM_BLOCK();
+    replay_log = f;
+    replay_begin(seed, mean);
+    replay_read();
+    VTALRM_UNBLOCK();
+    return 0;
+}
+
+/*
+  The part of gtthread_check_preempt out of line: counts a safepoint in
+  the deterministic mode, and otherwise yields as the monitor asked.
+ */
+void gtthread_safepoint(void)
+{
+    if (sched_deterministic)
+        replay_point();
+    else
+        gtthread_yield();
+}
+
+/*
+ * Starts the deterministic mode from GTTHREAD_REPLAY, or from
+ * GTTHREAD_SEED recording to GTTHREAD_RECORD if that is set.
+ */
+void replay_from_env(void)
+{
+    const char* path;
+    const char* seed;
+
+    if ((path = getenv("GTTHREAD_REPLAY")) != NULL && *path != '\0')
+    {
+        if (gtthread_replay_start(path) < 0)
+            perror("gtthread_replay_start");
+        return;
+    }
+    if ((seed = getenv("GTTHREAD_SEED")) == NULL || *seed == '\0')
+        return;
+    if ((path = getenv("GTTHREAD_RECORD")) != NULL && *path == '\0')
+        path = NULL;
+    if (gtthread_deterministic_start(strtoul(seed, NULL, 0), REPLAY_MEAN, path) < 0)
+        perror("gtthread_deterministic_start");
+}
+
+/*
+ * Counts a safepoint, and preempts the running thread if the countdown
+ * has run out, or if the recording being replayed preempted it here.
+ * The countdown is kept while replaying too, so that a replay that has
+ * run out of recording goes on as the seed would have it.
+ */
+void replay_point(void)
+{
+    int preempt;
+
+    VTALRM_BLOCK();
+    replay_points++;
+    preempt = --replay_countdown <= 0;
+    if (preempt)
+        replay_countdown = replay_draw();
+    if (replay_log != NULL)
+        preempt = replay_want.kind == 'p' && replay_want.points == replay_points;
+    VTALRM_UNBLOCK();
+
+    /* taken as a tick would be */
+    if (preempt)
+        sigvtalrm_handler(SIGVTALRM);
+}
+
+/*
+ * Records a switch, or checks it against the recording being replayed,
+ * which is given up on at the first that differs.
+ */
+void replay_switch(thread_t* prev, thread_t* next, int voluntary)
+{
+    char kind = voluntary ? 'v' : 'p';
+
+    if (replay_record != NULL)
+        fprintf(replay_record, "%lu %lu %lu %c\n",
+                replay_points, prev->tid, next->tid, kind);
+    if (replay_log == NULL)
+        return;
+    if (replay_want.points != replay_points || replay_want.from != prev->tid
+        || replay_want.to != next->tid || replay_want.kind != kind)
+    {
+        fprintf(stderr, "gtthread: replay diverged at safepoint %lu, switching "
+                "from %lu to %lu (%c) instead of from %lu to %lu (%c) at %lu\n",
+                replay_points, prev->tid, next->tid, kind, replay_want.from,
+                replay_want.to, replay_want.kind, replay_want.points);
+        fclose(replay_log);
+        replay_log = NULL;
+        return;
+    }
+    replay_read();
+}
+
+/*
+ * Returns the thread the recording being replayed switches to from the
+ * running one next, if it is in a ready queue, NULL otherwise.
+ */
+thread_t* replay_next(void)
+{
+    thread_t* t;
+
+    if (replay_log == NULL || replay_want.from != thread_current()->tid)
+        return NULL;
+    t = thread_get(replay_want.to);
+    if (t == NULL || t == thread_current() || t->state != GTTHREAD_RUNNING
+        || t->group == NULL || t->parked || (t->ucp == NULL && t->cancel_pending))
+        return NULL;
+    return t;
+}
+
+/*
+ * Seeds the generator and turns the timer off for good, as the mode
+ * preempts at safepoints instead. The scheduler keeps
+ * gtthread_preempt_requested set, so that every gtthread_check_preempt
+ * comes to gtthread_safepoint.
+ */
+static void replay_begin(unsigned long seed, long mean)
+{
+    /* xorshift must not start from 0 */
+    replay_state = (uint64_t) seed * 0x9E3779B97F4A7C15ULL + 1;
+    replay_mean = mean;
+    replay_points = 0;
+    replay_countdown = replay_draw();
+    sched_deterministic = 1;
+    gtthread_preempt_requested = 1;
+    timer_arm(0);
+}
+
+/*
+ * Draws the safepoints until the next preemption, from 1 to twice the
+ * mean less 1, so the mean on average.
+ */
+static long replay_draw(void)
+{
+    uint64_t x = replay_state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    replay_state = x;
+    return 1 + (long) ((x * 0x2545F4914F6CDD1DULL) % (uint64_t) (2 * replay_mean - 1));
+}
+
+/*
+ * Reads the next switch to replay, closing the recording at its end.
+ */
+static void replay_read(void)
+{
+    if (fscanf(replay_log, "%lu %lu %lu %c\n", &replay_want.points,
+               &replay_want.from, &replay_want.to, &replay_want.kind) != 4)
+    {
+        fclose(replay_log);
+        replay_log = NULL;
+    }
+}
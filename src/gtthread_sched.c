@@ -10,40 +10,85 @@ gtthreads library.  A simple round-robin queue should be used.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <signal.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <string.h>
 #include "gtthread.h"
+#include "gtthread_private.h"
 #include "steque.h"
 
-#define GTTHREAD_RUNNING 0 /* the thread is running */
-#define GTTHREAD_CANCEL 1 /* the thread is cancelled */
-#define GTTHREAD_DONE 2 /* the thread has done */
-
-typedef struct Thread_t
+/* a handler registered with gtthread_cleanup_push */
+typedef struct Cleanup_t
 {
-    gtthread_t tid;
-    gtthread_t joining;
-    int state;
-    void* (*proc)(void*);
+    void (*routine)(void*);
     void* arg;
-    void* retval;
-    ucontext_t* ucp; 
-} thread_t;   
+} cleanup_t;
+
+/* memory shared by the threads of one gtthread_create_n call */
+typedef struct Batch_t
+{
+    long live;          /* threads of the batch that have not exited */
+    thread_t* threads;  /* the control blocks, in creation order */
+    char* slots;        /* one slot per thread, see thread_prepare */
+} batch_t;
+
+/* a chain of handoffs runs at most this many threads before the front of
+ * the ready queue gets its turn, see thread_next */
+#define RUNNEXT_CHAIN_MAX 16
+
+/* a thread in the ready queue starves once this many more dispatches
+ * have gone by than round robin would have made it wait, see runq_starving */
+#define STARVE_DISPATCHES 64
 
 /* global data section */
-static steque_t ready_queue;
+static long ready_count;    /* threads in the ready queues of all groups */
+static runq_t parked;       /* threads over their CPU budget */
 static steque_t zombie_queue;
 static thread_t* current;
 static struct itimerval timer;
 sigset_t vtalrm;
+int sched_masking;          /* see signals_enable */
 static gtthread_t maxtid; 
+static ucontext_t template; /* new threads start from it, without CTX_ASM */
+static size_t slotsz;       /* a thread's stack plus its context */
+static void* dead_slot;     /* freed once we are off its stack */
+static batch_t* dead_batch; /* freed once we are off its stacks */
+static long daemons;        /* live daemon threads, see thread_daemon */
+unsigned long sched_switches;
+unsigned long sched_preemptions;
+unsigned long sched_starvations;
+long sched_period;          /* for threads without their own quantum */
+int sched_monitored;        /* the monitor preempts instead of the timer */
+static long timer_period;   /* the period the timer runs with */
+static thread_t* runnext;   /* woken thread to run next, see thread_wake */
+static thread_t** tids;     /* every control block, indexed by thread ID */
+static size_t tids_size;
+static int runnext_chain;   /* threads run from it since the queue's turn */
+volatile int gtthread_preempt_requested;
 
 /* private functions prototypes */
 void sigvtalrm_handler(int sig);
 void gtthread_start(void* (*start_routine)(void*), void* args);
-thread_t* thread_get(gtthread_t tid);
+static void thread_exit(void* retval, int state);
+static void thread_setup(thread_t* t);
+static void thread_prepare(thread_t* t);
+static void thread_release(thread_t* t);
+static thread_t* thread_next(int voluntary, thread_t* prev);
+static int thread_schedule(int voluntary);
+static int thread_switch(thread_t* next, int voluntary);
+static int tids_reserve(long n);
+#if GTTHREAD_ENABLE_STATS
+static void thread_account(thread_t* prev, thread_t* next, int voluntary);
+#endif
+static void stack_reap(void);
+static inline void timer_dispatch(thread_t* t);
+static inline void runq_remove(runq_t* q, thread_t* t);
+static inline int runq_starving(runq_t* q);
+static inline void ready_enqueue(thread_t* t);
+static inline void ready_take(runq_t* q, thread_t* t);
+static void thread_park(thread_t* t);
 
 /*
   The gtthread_init() function does not have a corresponding pthread equivalent.
@@ -63,21 +108,23 @@ thread_t* thread_get(gtthread_t tid);
  */
 void gtthread_init(long period)
 {
-    struct sigaction act;
+    const char* path;
 
     /* initializing data structures */
     maxtid = 1;
-    steque_init(&ready_queue);
+    if (tids_reserve(1) < 0)
+    {
+      perror("malloc");
+      exit(EXIT_FAILURE);
+    }
     
     /* create main thread and add it to ready queue */  
     /* only main thread is defined on heap and can be freed */
     thread_t* main_thread = (thread_t*) malloc(sizeof(thread_t));
-    main_thread->tid = maxtid++;
+    thread_setup(main_thread);
     main_thread->ucp = (ucontext_t*) malloc(sizeof(ucontext_t)); 
     memset(main_thread->ucp, '\0', sizeof(ucontext_t));
     main_thread->arg = NULL;
-    main_thread->state = GTTHREAD_RUNNING;
-    main_thread->joining = 0;
 
     /* must be called before makecontext */
     if (getcontext(main_thread->ucp) == -1)
@@ -93,25 +140,50 @@ void gtthread_init(long period)
     sigaddset(&vtalrm, SIGVTALRM);
     sigprocmask(SIG_UNBLOCK, &vtalrm, NULL); /* in case this is blocked previously */
 
-    /* set alarm signal and signal handler */
-    timer.it_interval.tv_usec = period;
-    timer.it_interval.tv_sec = 0;
-    timer.it_value.tv_usec = period;
-    timer.it_value.tv_sec = 0; 
-    
-    if (setitimer(ITIMER_VIRTUAL, &timer, NULL) < 0)
+    /* new threads start from this context, with the signal blocked until
+     * gtthread_start runs once signals_enable has added it; the stack size
+     * is rounded up to whole pages and one more page holds the context */
+    if (getcontext(&template) == -1)
+    {
+      perror("getcontext");
+      exit(EXIT_FAILURE);
+    }
+    template.uc_stack.ss_flags = 0;
+    template.uc_link = NULL;
+#if CTX_ASM
+    ctx_setup();
+#endif
+    slotsz = ((SIGSTKSZ + 4095) & ~(size_t) 4095) + 4096;
+
+    /* set alarm signal and signal handler; with a period of 0 the threads
+     * run cooperatively, and neither is set up until something asks for
+     * preemption */
+#if GTTHREAD_COOPERATIVE
+    period = 0;
+#endif
+    VTALRM_BLOCK();
+    if (timer_set(period) < 0)
     {
         perror("setitimer");
         exit(EXIT_FAILURE);
     }
+    VTALRM_UNBLOCK();
+#if GTTHREAD_ENABLE_TICKSTATS
+    ticks_start(period);
+#endif
 
-    /* install signal handler for SIGVTALRM */  
-    memset(&act, '\0', sizeof(act));
-    act.sa_handler = &sigvtalrm_handler;
-    if (sigaction(SIGVTALRM, &act, NULL) < 0)
+    /* tracing can be turned on without changing the program */
+    if ((path = getenv("GTTHREAD_TRACE")) != NULL && *path != '\0')
     {
-      perror ("sigaction");
-      exit(EXIT_FAILURE);
+        if (gtthread_trace_start(path, 0) < 0)
+            perror("gtthread_trace_start");
+    }
+    prof_from_env();
+    replay_from_env();
+    if ((path = getenv("GTTHREAD_METRICS")) != NULL && *path != '\0')
+    {
+        if (gtthread_metrics_start(path) < 0)
+            perror("gtthread_metrics_start");
     }
 }
 
@@ -125,38 +197,102 @@ int gtthread_create(gtthread_t *thread,
 		    void *arg)
 {
     /* block SIGVTALRM signal */
-    sigprocmask(SIG_BLOCK, &vtalrm, NULL);
+    VTALRM_BLOCK();
     
     /* allocate heap for thread, it cannot be stored on stack */
     thread_t* t = malloc(sizeof(thread_t));
-    *thread = t->tid = maxtid++; // need to block signal
-    t->state = GTTHREAD_RUNNING;
+    if (t == NULL || tids_reserve(1) < 0)
+    {
+        free(t);
+        VTALRM_UNBLOCK();
+        return -1;
+    }
+    thread_setup(t); // need to block signal
+    *thread = t->tid;
     t->proc = start_routine;
     t->arg = arg;
-    t->ucp = (ucontext_t*) malloc(sizeof(ucontext_t));
-    t->joining = 0;
-    memset(t->ucp, '\0', sizeof(ucontext_t));
+    LATENCY_READY(t, NEW);
+    TRACE(CREATE, current->tid, t->tid);
+    PROBE2(create, current->tid, t->tid);
 
-    if (getcontext(t->ucp) == -1)
+    /* the stack and context are only set up when the thread is first
+     * dispatched, see thread_prepare */
+    ready_enqueue(t);
+
+    /* unblock the signal */
+    VTALRM_UNBLOCK();   
+    return 0; 
+}
+
+/*
+  The gtthread_create_n() function creates n threads running start_routine
+  in one call. Thread i gets the argument (char*) args + i * stride, so a
+  stride of 0 passes the same argument to all of them, and its ID is
+  stored in handles[i]. The control blocks and stacks are allocated in
+  bulk and the whole batch is queued with the signal blocked once; as for
+  gtthread_create, a stack is only touched when its thread first runs.
+  Returns -1 with errno EINVAL if n is negative or too large for the
+  batch's memory to be sized.
+ */
+int gtthread_create_n(gtthread_t *handles, long n,
+                      void *(*start_routine)(void *),
+                      void *args, size_t stride)
+{
+    batch_t* batch;
+    long i;
+
+    if (n == 0)
+        return 0;
+    if (n < 0 || (size_t) n > SIZE_MAX / slotsz
+        || (size_t) n > SIZE_MAX / sizeof(thread_t))
     {
-      perror("getcontext");
-      exit(EXIT_FAILURE);
+        errno = EINVAL;
+        return -1;
     }
-    
-    /* allocate stack for the newly created context */
-    /* here we allocate the stack size using the canonical */
-    /* size for signal stack. */
-    t->ucp->uc_stack.ss_sp = malloc(SIGSTKSZ);
-    t->ucp->uc_stack.ss_size = SIGSTKSZ;
-    t->ucp->uc_stack.ss_flags = 0;
-    t->ucp->uc_link = NULL;
 
-    makecontext(t->ucp, (void (*)(void)) gtthread_start, 2, start_routine, arg);
-    steque_enqueue(&ready_queue, t);
+    /* block SIGVTALRM signal */
+    VTALRM_BLOCK();
+    stack_reap();
+
+    /* control blocks stay around as zombies, like those of gtthread_create */
+    batch = tids_reserve(n) == 0 ? (batch_t*) malloc(sizeof(batch_t)) : NULL;
+    if (batch != NULL)
+    {
+        batch->threads = (thread_t*) malloc((size_t) n * sizeof(thread_t));
+        if (posix_memalign((void**) &batch->slots, 4096, (size_t) n * slotsz) != 0)
+            batch->slots = NULL;
+    }
+    if (batch == NULL || batch->threads == NULL || batch->slots == NULL)
+    {
+        if (batch != NULL)
+        {
+            free(batch->threads);
+            free(batch->slots);
+        }
+        free(batch);
+        VTALRM_UNBLOCK();
+        return -1;
+    }
+    batch->live = n;
+
+    for (i = 0; i < n; i++)
+    {
+        thread_t* t = &batch->threads[i];
+
+        thread_setup(t);
+        handles[i] = t->tid;
+        t->proc = start_routine;
+        t->arg = (char*) args + i * stride;
+        t->batch = batch;
+        LATENCY_READY(t, NEW);
+        TRACE(CREATE, current->tid, t->tid);
+        PROBE2(create, current->tid, t->tid);
+        ready_enqueue(t);
+    }
 
     /* unblock the signal */
-    sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);   
-    return 0; 
+    VTALRM_UNBLOCK();
+    return 0;
 }
 
 /*
@@ -178,20 +314,36 @@ int gtthread_join(gtthread_t thread, void **status)
     if (t->joining == current->tid)
         return -1;
 
+    /* join is a cancellation point */
+    gtthread_testcancel();
+
+    VTALRM_BLOCK();
     current->joining = t->tid;
+    if (t->state == GTTHREAD_RUNNING)
+    {
+        t->joiner = current->tid;
+        TRACE(JOIN_WAIT, current->tid, t->tid);
+        PROBE2(join_wait, current->tid, t->tid);
+    }
+
     /* wait on the thread to terminate */
     while (t->state == GTTHREAD_RUNNING)
     {
-        sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);
-        sigvtalrm_handler(SIGVTALRM);
-        sigprocmask(SIG_BLOCK, &vtalrm, NULL);
+        VTALRM_UNBLOCK();
+        sigvtalrm_handler(0);
+        gtthread_testcancel();
+        VTALRM_BLOCK();
     }
+    current->joining = 0;
+    TRACE(JOIN, current->tid, t->tid);
+    PROBE2(join, current->tid, t->tid);
+    VTALRM_UNBLOCK();
 
     if (status == NULL)
         return 0;
 
     if (t->state == GTTHREAD_CANCEL)
-        *status = (void*) GTTHREAD_CANCEL;
+        *status = GTTHREAD_CANCELED;
     else if (t->state == GTTHREAD_DONE)
         *status = t->retval;
 
@@ -203,46 +355,119 @@ int gtthread_join(gtthread_t thread, void **status)
  */
 void gtthread_exit(void* retval)
 {
+    thread_exit(retval, GTTHREAD_DONE);
+}
+
+/*
+  Terminates the calling thread, leaving it in the given final state
+  (GTTHREAD_DONE or GTTHREAD_CANCEL). Cleanup handlers still pushed are
+  run first, most recent first, as pthread_exit does.
+ */
+static void thread_exit(void* retval, int state)
+{
+    cleanup_t* c;
+    thread_t* j;
+
     /* block alarm signal */
-    sigprocmask(SIG_BLOCK, &vtalrm, NULL);
+    VTALRM_BLOCK();
 
-    if (steque_isempty(&ready_queue))
+    /* a thread leaving while parked on a mutex gives up its place */
+    if (current->waiting != NULL)
+    {
+        steque_remove(current->waiting, (steque_item) current);
+        current->waiting = NULL;
+    }
+
+    /* handlers may block, but must not act on the cancel request again */
+    current->cancel_state = GTTHREAD_CANCEL_DISABLE;
+    while (!steque_isempty(&current->cleanup))
+    {
+        c = (cleanup_t*) steque_pop(&current->cleanup);
+        VTALRM_UNBLOCK();
+        (*c->routine)(c->arg);
+        free(c);
+        VTALRM_BLOCK();
+    }
+    TRACE(EXIT, current->tid, state);
+    PROBE2(exit, current->tid, state);
+    if (current->daemon)
+        daemons--;
+    if (current->budget.size != 0)
+        budget_threads--;
+
+    /* daemon threads do not keep the program alive */
+    if (ready_count + parked.n == daemons)
     { 
-        sigprocmask(SIG_UNBLOCK, &vtalrm, NULL); 
+        VTALRM_UNBLOCK(); 
         exit((long) retval);
     }
 
     /* if the main thread call gtthread_exit */
     if (current->tid == 1)
     {
-        while (!steque_isempty(&ready_queue))
+        while (ready_count + parked.n > daemons)
         {
-            sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);  
-            sigvtalrm_handler(SIGVTALRM);
-            sigprocmask(SIG_BLOCK, &vtalrm, NULL);
+            VTALRM_UNBLOCK();  
+            sigvtalrm_handler(0);
+            VTALRM_BLOCK();
         }
-        sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);   
+        VTALRM_UNBLOCK();   
         exit((long) retval);
     }
 
+    /* the thread joining it is handed the CPU, as a mutex waiter is */
+    if ((j = thread_get(current->joiner)) != NULL && j->joining == current->tid)
+        thread_wake(j);
+
+    TICKS_ENTER(0);
+    gtthread_preempt_requested = sched_deterministic;
     thread_t* prev = current; 
-    current = (thread_t*) steque_pop(&ready_queue);
+    current = thread_next(1, NULL);
+    if (current == NULL)
+    {
+        /* all that was left had been cancelled before it ever ran */
+        VTALRM_UNBLOCK(); 
+        exit((long) retval);
+    }
     current->state = GTTHREAD_RUNNING; 
+    if (runnext_chain == 0)
+        timer_dispatch(current);
 
     /* free up memory allocated for exit thread */
-    free(prev->ucp->uc_stack.ss_sp); 
-    free(prev->ucp);                
-    prev->ucp = NULL;
+    thread_release(prev);
 
-    /* mark the exit thread as DONE and add to zombie_queue */ 
-    prev->state = GTTHREAD_DONE; 
+    /* mark the exit thread as DONE or CANCEL and add to zombie_queue */
+    prev->state = state;
     prev->retval = retval;
     prev->joining = 0;
+    prev->group->members--;
+    prev->group = NULL;
     steque_enqueue(&zombie_queue, prev);
+#if GTTHREAD_ENABLE_LATENCY
+    {
+        group_t* g;
+        thread_t* t;
+
+        /* its joiners can go on */
+        for (g = &group_default; g != NULL; g = g->next)
+            for (t = g->queue.front; t != NULL; t = t->rq_next)
+                if (t->joining == prev->tid)
+                    LATENCY_READY(t, WOKEN);
+    }
+#endif
+    LATENCY_RUN(current);
+    sched_switches++;
+#if GTTHREAD_ENABLE_STATS
+    thread_account(prev, current, 1);
+#endif
+    if (sched_deterministic)
+        replay_switch(prev, current, 1);
+    TRACE(SWITCH, prev->tid, current->tid);
+    PROBE3(switch, prev->tid, current->tid, 1);
 
-    /* unblock alarm signal and setcontext for next thread */
-    sigprocmask(SIG_UNBLOCK, &vtalrm, NULL); 
-    setcontext(current->ucp);
+    /* jump to the next thread; it unblocks the alarm signal itself once
+     * it runs, so no tick can land while current and the stack disagree */
+    ctx_jump(current);
 }
 
 /*
@@ -253,21 +478,88 @@ void gtthread_exit(void* retval)
 int gtthread_yield(void)
 {
     /* block SIGVTALRM signal */
-    sigprocmask(SIG_BLOCK, &vtalrm, NULL);
+    VTALRM_BLOCK();
+    TICKS_ENTER(0);
+    TRACE(YIELD, current->tid, 0);
     
     /* if no thread to yield, simply return */
-    if (steque_isempty(&ready_queue))
+    if (!thread_schedule(1))
+    {
+        TICKS_LEAVE();
+        VTALRM_UNBLOCK();
+    }
+    return 0; 
+}
+
+/*
+  The gtthread_yield_to() function switches straight to the given thread
+  if it is ready to run, putting the caller at the back of the schedule
+  queue as gtthread_yield does but leaving the rest of the queue as it
+  is. A thread still waiting on a mutex or a join could not go on, nor
+  can one parked over its CPU budget, so the caller then simply yields,
+  as it does while the front of the thread's queue is starving or its
+  group has had more than its share.
+  Returns -1 if there is no such live thread; yielding to oneself does
+  nothing.
+ */
+int gtthread_yield_to(gtthread_t thread)
+{
+    thread_t* t;
+
+    VTALRM_BLOCK();
+    t = thread_get(thread);
+    if (t == NULL || t->state != GTTHREAD_RUNNING)
+    {
+        VTALRM_UNBLOCK();
+        errno = ESRCH;
+        return -1;
+    }
+    if (t == current)
+    {
+        VTALRM_UNBLOCK();
         return 0;
+    }
+    TICKS_ENTER(0);
+    TRACE(YIELD, current->tid, thread);
 
-    thread_t* next = (thread_t*) steque_pop(&ready_queue);
-    thread_t* prev = current;
-    steque_enqueue(&ready_queue, current);
-    current = next;
+    if (t->parked || (sched_charging() && !group_admits(t->group)))
+        t = NULL;
 
-    /* unblock the signal */
-    sigprocmask(SIG_UNBLOCK, &vtalrm, NULL); 
-    swapcontext(prev->ucp, current->ucp); 
-    return 0; 
+    /* a starving thread goes first, see runq_starving */
+    else if (t != t->group->queue.front && runq_starving(&t->group->queue))
+    {
+        sched_starvations++;
+        t = NULL;
+    }
+    if (t == NULL || thread_blocked(t) || (t->ucp == NULL && t->cancel_pending))
+    {
+        if (!thread_schedule(1))
+        {
+            TICKS_LEAVE();
+            VTALRM_UNBLOCK();
+        }
+        return 0;
+    }
+
+    /* the queue keeps its order, and any woken thread its turn after */
+    gtthread_preempt_requested = sched_deterministic;
+    ready_take(&t->group->queue, t);
+    if (runnext == t)
+        runnext = NULL;
+    runnext_chain = 0;
+    if (t->ucp == NULL)
+        thread_prepare(t);
+    thread_switch(t, 1);
+    return 0;
+}
+
+/*
+  Returns how many times a starving thread has been run ahead of the one
+  the scheduler would have picked, see runq_starving.
+ */
+unsigned long gtthread_starvations(void)
+{
+    return sched_starvations;
 }
 
 /*
@@ -280,42 +572,121 @@ int  gtthread_equal(gtthread_t t1, gtthread_t t2)
 }
 
 /*
-  The gtthread_cancel() function is analogous to pthread_cancel,
-  allowing one thread to terminate another asynchronously.
+  The gtthread_cancel() function is analogous to pthread_cancel.
+  The request is recorded on the target, which acts on it itself: at the
+  next cancellation point (gtthread_join, gtthread_mutex_lock while
+  waiting, gtthread_testcancel) if its cancel type is deferred (the
+  default), or also whenever it gives up the CPU, as in gtthread_yield,
+  if it is asynchronous. A thread is never cancelled from a tick. Either
+  way the target runs its cleanup handlers on its own stack before
+  terminating.
  */
 int gtthread_cancel(gtthread_t thread)
 {
-    /* if a thread cancel itself */
+    thread_t* t;
+
+    VTALRM_BLOCK();
     if (gtthread_equal(current->tid, thread))
-        gtthread_exit(0);
+        t = current;
+    else
+        t = thread_get(thread);
 
-    sigprocmask(SIG_BLOCK, &vtalrm, NULL);
-    thread_t* t = thread_get(thread);
-    if (t == NULL)
+    if (t == NULL || t->state != GTTHREAD_RUNNING || t->cancel_pending)
     {
-        sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);    
+        VTALRM_UNBLOCK();
         return -1;
     }
-    if (t->state == GTTHREAD_DONE)
+    t->cancel_pending = 1;
+    PROBE2(cancel, current->tid, t->tid);
+    VTALRM_UNBLOCK();
+
+    /* a thread cancelling itself asynchronously does not come back */
+    if (t == current && t->cancel_type == GTTHREAD_CANCEL_ASYNCHRONOUS)
+        gtthread_testcancel();
+    return 0;
+}
+
+/*
+  The gtthread_setcancelstate() function is analogous to
+  pthread_setcancelstate. While cancellation is disabled a request stays
+  pending and is acted on once it is enabled again.
+ */
+int gtthread_setcancelstate(int state, int* oldstate)
+{
+    if (state != GTTHREAD_CANCEL_ENABLE && state != GTTHREAD_CANCEL_DISABLE)
+        return -1;
+    if (oldstate != NULL)
+        *oldstate = current->cancel_state;
+    current->cancel_state = state;
+    return 0;
+}
+
+/*
+  The gtthread_setcanceltype() function is analogous to
+  pthread_setcanceltype.
+ */
+int gtthread_setcanceltype(int type, int* oldtype)
+{
+    if (type != GTTHREAD_CANCEL_DEFERRED && type != GTTHREAD_CANCEL_ASYNCHRONOUS)
+        return -1;
+    if (oldtype != NULL)
+        *oldtype = current->cancel_type;
+    current->cancel_type = type;
+    return 0;
+}
+
+/*
+  The gtthread_testcancel() function is analogous to pthread_testcancel,
+  creating a cancellation point in the calling thread.
+ */
+void gtthread_testcancel(void)
+{
+    if (current->cancel_pending && current->cancel_state == GTTHREAD_CANCEL_ENABLE)
+        thread_exit(GTTHREAD_CANCELED, GTTHREAD_CANCEL);
+}
+
+/*
+  The gtthread_cleanup_push() and gtthread_cleanup_pop() functions are
+  analogous to pthread_cleanup_push and pthread_cleanup_pop. They are
+  plain functions rather than macros, but calls should still be paired
+  within the same function. Pushing fails, returning -1, if no memory is
+  left for the handler.
+ */
+int gtthread_cleanup_push(void (*routine)(void*), void* arg)
+{
+    cleanup_t* c;
+
+    VTALRM_BLOCK();
+    if ((c = (cleanup_t*) malloc(sizeof(cleanup_t))) == NULL)
     {
-        sigprocmask(SIG_UNBLOCK, &vtalrm, NULL); 
+        VTALRM_UNBLOCK();
         return -1;
     }
-    if (t->state == GTTHREAD_CANCEL)
+    c->routine = routine;
+    c->arg = arg;
+    steque_push(&current->cleanup, c);
+    VTALRM_UNBLOCK();
+    return 0;
+}
+
+void gtthread_cleanup_pop(int execute)
+{
+    cleanup_t* c;
+
+    VTALRM_BLOCK();
+    if (steque_isempty(&current->cleanup))
     {
-        sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);  
-        return -1;
+        VTALRM_UNBLOCK();
+        return;
     }
-    else
-        t->state = GTTHREAD_CANCEL;
+    c = (cleanup_t*) steque_pop(&current->cleanup);
+    VTALRM_UNBLOCK();
 
-    free(t->ucp->uc_stack.ss_sp);
-    free(t->ucp);
-    t->ucp = NULL;
-    t->joining = 0;
-    steque_enqueue(&zombie_queue, t);
-    sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);
-    return 0;
+    if (execute)
+        (*c->routine)(c->arg);
+    VTALRM_BLOCK();
+    free(c);
+    VTALRM_UNBLOCK();
 }
 
 /*
@@ -326,11 +697,438 @@ gtthread_t gtthread_self(void)
     return current->tid;
 }
 
+thread_t* thread_current(void)
+{
+    return current;
+}
+
+long thread_queued(void)
+{
+    return ready_count;
+}
+
+/*
+ * Tells whether a thread is waiting for a mutex it has not been handed
+ * yet or for a thread that is still running to terminate, so that it
+ * would only poll again if run.
+ */
+int thread_blocked(thread_t* t)
+{
+    return (t->waiting != NULL && (thread_t*) steque_front(t->waiting) != t)
+        || (t->joining != 0 && thread_get(t->joining)->state == GTTHREAD_RUNNING);
+}
+
+/*
+ * Has a thread that was just handed a mutex, or whose join target is
+ * exiting, and still polls for it in the ready queue, run at the next
+ * voluntary switch instead of once the queue has come round, while what
+ * it waited on is still in the cache.
+ * It replaces any thread woken before that has not run yet, which keeps
+ * its place in the queue. A parked thread waits for its budget instead.
+ */
+void thread_wake(thread_t* t)
+{
+    LATENCY_READY(t, WOKEN);
+    if (!t->parked)
+        runnext = t;
+}
+
+/*
+ * Sets the preemption period of the threads without a quantum of their
+ * own to 'period' microseconds, 0 meaning none, starting a new quantum
+ * if the running thread is one of them. Returns -1 if the timer cannot
+ * be set.
+ */
+int timer_set(long period)
+{
+    sched_period = period;
+    if (current->quantum != 0)
+        return 0;
+    return timer_arm(period);
+}
+
+/*
+ * Starts a quantum of 'period' microseconds, 0 meaning none, which it
+ * always is in the deterministic mode and while the monitor runs.
+ */
+int timer_arm(long period)
+{
+    if (sched_deterministic || sched_monitored)
+        period = 0;
+    if (period != 0 && signals_enable() < 0)
+        return -1;
+    timer.it_interval.tv_sec = period / 1000000;
+    timer.it_interval.tv_usec = period % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_VIRTUAL, &timer, NULL) < 0)
+        return -1;
+    timer_period = period;
+    return 0;
+}
+
+/*
+ * Gives a thread being dispatched a full quantum of its own length if it
+ * has one, and puts the timer back after such a thread. Threads without
+ * one carry on with the running quantum, so they cost no system call.
+ * While the monitor runs there is no timer to set.
+ */
+static inline void timer_dispatch(thread_t* t)
+{
+    if (sched_monitored)
+        return;
+    if (t->quantum != 0)
+        timer_arm(t->quantum);
+    else if (timer_period != sched_period)
+        timer_arm(sched_period);
+}
+
+static inline void runq_remove(runq_t* q, thread_t* t)
+{
+    if (t->rq_prev != NULL)
+        t->rq_prev->rq_next = t->rq_next;
+    else
+        q->front = t->rq_next;
+    if (t->rq_next != NULL)
+        t->rq_next->rq_prev = t->rq_prev;
+    else
+        q->back = t->rq_prev;
+    q->n--;
+}
+
+/*
+ * Tells whether the front of the queue is starving: round robin would
+ * have run it by the dispatch from the queue it was queued for, and
+ * threads run ahead of it, woken by a mutex or yielded to, have since
+ * held it back for more than STARVE_DISPATCHES more. Wait is counted in
+ * dispatches rather than time, so the check reads no clock. Being the
+ * oldest, the front is the thread that has waited longest.
+ */
+static inline int runq_starving(runq_t* q)
+{
+    return q->front != NULL
+        && (long) (q->dispatched - q->front->rq_due) > STARVE_DISPATCHES;
+}
+
+/*
+ * Puts a thread at the back of the ready queue of its group.
+ */
+static inline void ready_enqueue(thread_t* t)
+{
+    runq_t* q = &t->group->queue;
+
+    if (q->n == 0 && group_count > 1)
+        group_wake(t->group);
+    t->rq_due = q->dispatched + q->n;
+    t->rq_next = NULL;
+    t->rq_prev = q->back;
+    if (q->back != NULL)
+        q->back->rq_next = t;
+    else
+        q->front = t;
+    q->back = t;
+    q->n++;
+    ready_count++;
+}
+
+/*
+ * Takes a thread out of q, the ready queue of its group, to run it.
+ */
+static inline void ready_take(runq_t* q, thread_t* t)
+{
+    if (t->rq_prev != NULL)
+        t->rq_prev->rq_next = t->rq_next;
+    else
+        q->front = t->rq_next;
+    if (t->rq_next != NULL)
+        t->rq_next->rq_prev = t->rq_prev;
+    else
+        q->back = t->rq_prev;
+    q->n--;
+    q->dispatched++;
+    ready_count--;
+}
+
+/*
+ * Parks a thread that has used up its CPU budget, keeping it out of the
+ * ready queues until thread_unpark finds its budget has come back.
+ */
+static void thread_park(thread_t* t)
+{
+    t->parked = 1;
+    t->rq_next = NULL;
+    t->rq_prev = parked.back;
+    if (parked.back != NULL)
+        parked.back->rq_next = t;
+    else
+        parked.front = t;
+    parked.back = t;
+    parked.n++;
+}
+
+uint64_t thread_unpark(uint64_t now)
+{
+    uint64_t first = UINT64_MAX;
+    uint64_t due;
+    thread_t* t;
+    thread_t* next;
+
+    for (t = parked.front; t != NULL; t = next)
+    {
+        next = t->rq_next;
+        due = budget_due(&t->budget, now);
+        if (due == now)
+        {
+            runq_remove(&parked, t);
+            t->parked = 0;
+            ready_enqueue(t);
+        }
+        else if (due < first)
+            first = due;
+    }
+    return first;
+}
+
+/*
+ * Gives a new control block the next thread ID and the default state.
+ * Must be called with SIGVTALRM blocked.
+ */
+static void thread_setup(thread_t* t)
+{
+    t->tid = maxtid++;
+    tids[t->tid] = t;
+    t->group = current != NULL ? current->group : &group_default;
+    t->group->members++;
+    t->state = GTTHREAD_RUNNING;
+    t->joining = 0;
+    t->joiner = 0;
+    t->ucp = NULL;
+    t->batch = NULL;
+    t->cancel_state = GTTHREAD_CANCEL_ENABLE;
+    t->cancel_type = GTTHREAD_CANCEL_DEFERRED;
+    t->cancel_pending = 0;
+    t->waiting = NULL;
+    t->daemon = 0;
+    t->quantum = 0;
+    t->budget.size = 0;
+    t->parked = 0;
+    steque_init(&t->cleanup);
+#if GTTHREAD_ENABLE_LATENCY
+    t->ready_class = -1;
+#endif
+#if GTTHREAD_ENABLE_STATS
+    t->since = clock_ticks();
+    t->run_ticks = 0;
+    t->wait_ticks = 0;
+    t->blocked_ticks = 0;
+    t->nvcsw = 0;
+    t->nivcsw = 0;
+    t->npreempt = 0;
+#endif
+}
+
+/*
+ * Sets up the stack and context of a thread when it is first dispatched,
+ * so that threads waiting to run for the first time only cost a control
+ * block. The stack lives in a page-aligned slot with the context at its
+ * top, so starting the thread touches a single page. Must be called with
+ * SIGVTALRM blocked.
+ */
+static void thread_prepare(thread_t* t)
+{
+    size_t stksz = (slotsz - sizeof(ucontext_t)) & ~(size_t) 63;
+    char* slot;
+
+    if (t->batch != NULL)
+        slot = t->batch->slots + (t - t->batch->threads) * slotsz;
+    else if (posix_memalign((void**) &slot, 4096, slotsz) != 0)
+    {
+      perror("posix_memalign");
+      exit(EXIT_FAILURE);
+    }
+
+    t->ucp = (ucontext_t*) (slot + stksz);
+#if CTX_ASM
+    t->ucp->uc_stack.ss_sp = slot;
+    t->ucp->uc_stack.ss_size = stksz;
+    ctx_init(t);
+#else
+#if defined(__x86_64__) && defined(__GLIBC__)
+    memcpy(t->ucp, &template, sizeof(ucontext_t));
+    /* glibc keeps a pointer to the FP state inside the context itself */
+    t->ucp->uc_mcontext.fpregs = &t->ucp->__fpregs_mem;
+#else
+    if (getcontext(t->ucp) == -1)
+    {
+      perror("getcontext");
+      exit(EXIT_FAILURE);
+    }
+    t->ucp->uc_sigmask = template.uc_sigmask;
+    t->ucp->uc_stack.ss_flags = 0;
+    t->ucp->uc_link = NULL;
+#endif
+    t->ucp->uc_stack.ss_sp = slot;
+    t->ucp->uc_stack.ss_size = stksz;
+
+    makecontext(t->ucp, (void (*)(void)) gtthread_start, 2, t->proc, t->arg);
+#endif
+}
+
+/*
+ * Gives back the stack of a thread that has terminated. The exiting
+ * thread is still running on it, so the memory is only freed on the
+ * next release or batch creation, once we have switched away.
+ */
+static void thread_release(thread_t* t)
+{
+    if (t->batch == NULL)
+    {
+        if (t->ucp != NULL)
+        {
+            stack_reap();
+            dead_slot = t->ucp->uc_stack.ss_sp;
+        }
+    }
+    else if (--t->batch->live == 0)
+    {
+        stack_reap();
+        dead_batch = t->batch;
+    }
+    t->ucp = NULL;
+}
+
+/*
+ * Returns the bytes of stack held by a thread, running or terminated.
+ * The threads of a batch hold their slots until the whole batch is gone.
+ */
+size_t thread_stack_bytes(thread_t* t)
+{
+    if (t->batch != NULL)
+        return t->batch->live > 0 ? slotsz : 0;
+    /* the main thread runs on the process stack */
+    return t->ucp != NULL && t->tid != 1 ? slotsz : 0;
+}
+
+static void stack_reap(void)
+{
+    free(dead_slot);
+    dead_slot = NULL;
+    if (dead_batch != NULL)
+    {
+        free(dead_batch->slots);
+        free(dead_batch);
+        dead_batch = NULL;
+    }
+}
+
+/*
+ * Takes the next thread to run from the ready queue, setting it up if it
+ * has never run. A thread cancelled before it ever ran is retired on the
+ * way without getting a stack. Returns NULL if nothing is left to run,
+ * or if prev, the running thread unless it is exiting, should go on.
+ * With groups, the thread comes from the queue of the group group_pick
+ * chooses.
+ *
+ * On a voluntary switch, a thread woken by thread_wake goes first. It
+ * inherits what is left of the running quantum, so runnext_chain is
+ * left non-zero for the caller not to re-arm the timer: a chain of
+ * threads handing a mutex to each other gets one quantum between them,
+ * and a tick, or RUNNEXT_CHAIN_MAX threads when there are no ticks,
+ * gives the front of the queue its turn. So does the front starving.
+ * A replay switches to the thread recorded instead.
+ */
+static thread_t* thread_next(int voluntary, thread_t* prev)
+{
+    thread_t* t = runnext;
+    group_t* g;
+
+    if (sched_deterministic && (t = replay_next()) != NULL)
+    {
+        runnext_chain = t == runnext ? runnext_chain + 1 : 0;
+        runnext = NULL;
+        ready_take(&t->group->queue, t);
+        if (t->ucp == NULL)
+            thread_prepare(t);
+        return t;
+    }
+    t = runnext;
+    runnext = NULL;
+    if (t != NULL && voluntary && runnext_chain < RUNNEXT_CHAIN_MAX
+        && (!sched_charging() || group_admits(t->group)))
+    {
+        /* a starving thread goes first */
+        if (t == t->group->queue.front || !runq_starving(&t->group->queue))
+        {
+            ready_take(&t->group->queue, t);
+            runnext_chain++;
+            return t;
+        }
+        sched_starvations++;
+    }
+    runnext_chain = 0;
+    for (;;)
+    {
+        g = sched_charging() ? group_pick(prev) : &group_default;
+        if (g == NULL || (t = g->queue.front) == NULL)
+            return NULL;
+        ready_take(&g->queue, t);
+        if (t->ucp != NULL)
+            return t;
+
+        if (!t->cancel_pending)
+        {
+            thread_prepare(t);
+            return t;
+        }
+        thread_release(t);
+        if (t->daemon)
+            daemons--;
+        if (t->budget.size != 0)
+            budget_threads--;
+        TRACE(EXIT, t->tid, GTTHREAD_CANCEL);
+        PROBE2(exit, t->tid, GTTHREAD_CANCEL);
+        t->state = GTTHREAD_CANCEL;
+        t->retval = GTTHREAD_CANCELED;
+        t->group->members--;
+        t->group = NULL;
+        steque_enqueue(&zombie_queue, t);
+    }
+}
 
 /*
  * helper functions to install the signal handler 
  */
 
+/*
+ * Installs the handler for SIGVTALRM and has the scheduler mask it from
+ * now on, along with any signal added to vtalrm. A cooperative run leaves
+ * both off, so a yield costs no system calls, until a timer or the dump
+ * signal needs them. The caller is in a critical section,
+ * whose unblocking then takes effect.
+ */
+int signals_enable(void)
+{
+#if GTTHREAD_COOPERATIVE
+    errno = ENOSYS;
+    return -1;
+#else
+    struct sigaction act;
+
+    if (sched_masking)
+        return 0;
+    memset(&act, '\0', sizeof(act));
+    act.sa_handler = &sigvtalrm_handler;
+    if (sigaction(SIGVTALRM, &act, NULL) < 0)
+        return -1;
+
+    /* threads created from here on start with it blocked, like the
+     * others that resume in the scheduler */
+    sigaddset(&template.uc_sigmask, SIGVTALRM);
+    sched_masking = 1;
+    sigprocmask(SIG_BLOCK, &vtalrm, NULL);
+    return 0;
+#endif
+}
+
 /* 
  * A wrapper function to start a routine.
  * The reason we need this is because we need to call gtthread_exit
@@ -339,7 +1137,11 @@ gtthread_t gtthread_self(void)
 void gtthread_start(void* (*start_routine)(void*), void* args)
 {
     /* unblock signal comes from gtthread_create */
-    sigprocmask(SIG_UNBLOCK, &vtalrm, NULL);
+    TICKS_LEAVE();
+    VTALRM_UNBLOCK();
+
+    /* a thread cancelled before it ever ran does not start */
+    gtthread_testcancel();
 
     /* start executing the start routine*/
     current->retval = (*start_routine)(args);
@@ -353,56 +1155,210 @@ void gtthread_start(void* (*start_routine)(void*), void* args)
  * Comes here when a thread runs up its time slot. This handler implements
  * a preemptive thread scheduler. It looks at the global ready queue, pop
  * the thread in the front, save the current thread context and switch context. 
+ * Threads waiting on a mutex or a join call it with sig 0 to give up the
+ * processor.
  */
 void sigvtalrm_handler(int sig)
 {
-    /* block the signal */
-    sigprocmask(SIG_BLOCK, &vtalrm, NULL);
+    /* block the signal, and only then take the entry stamp, so that a
+     * tick cannot come in between and overwrite it */
+    VTALRM_BLOCK();
+    TICKS_ENTER(sig);
+    if (sig == SIGVTALRM)
+    {
+        sched_preemptions++;
+        if (quantum_adaptive)
+            quantum_tick();
+#if GTTHREAD_ENABLE_STATS
+        current->npreempt++;
+#endif
+        TRACE(PREEMPT, current->tid, 0);
+    }
 
-    /* if no thread in the ready queue, resume execution */
-    if (steque_isempty(&ready_queue))
-        return;
+    /* switch to the next runnable thread, if there is one */
+    if (!thread_schedule(sig != SIGVTALRM))
+        TICKS_LEAVE();
+    else if (quantum_adaptive)
+        quantum_resumed();
+}
+
+/*
+ * Switches from the running thread to the next runnable one, putting the
+ * running thread at the back of the ready queue. 'voluntary' tells a
+ * yield or a wait from a tick. Must be called with SIGVTALRM blocked;
+ * returns 0 with it still blocked if there is nothing else to run, and 1
+ * with it unblocked once the thread has been switched back to.
+ */
+static int thread_schedule(int voluntary)
+{
+    thread_t* next;
 
-    /* get the next runnable thread and use preemptive scheduling */
-    thread_t* next = (thread_t*) steque_pop(&ready_queue);
-    while (next->state == GTTHREAD_CANCEL)
+    /* whoever runs next starts with a fresh request; a thread over its
+     * budget or in a capped group may have to idle even with no other
+     * thread to run */
+    gtthread_preempt_requested = sched_deterministic;
+    if ((ready_count == 0 && !sched_charging())
+        || (next = thread_next(voluntary, current)) == NULL)
+        return 0;
+    return thread_switch(next, voluntary);
+}
+
+/*
+ * Switches from the running thread to next, taken out of the ready queue
+ * already, and puts the running thread at the back of the queue, or parks
+ * it if it has used up its CPU budget, as charged by the pick. Called
+ * with SIGVTALRM blocked, it returns 1 with it unblocked once the thread
+ * has been switched back to.
+ */
+static int thread_switch(thread_t* next, int voluntary)
+{
+    thread_t* prev = current;
+
+    if (prev->budget.size != 0 && prev->budget.tokens <= 0)
+        thread_park(prev);
+    else
+        ready_enqueue(prev);
+#if GTTHREAD_ENABLE_LATENCY
+    /* a thread waiting on a mutex or a join is not ready until woken */
+    if (prev->waiting == NULL && prev->joining == 0)
     {
-        steque_enqueue(&zombie_queue, next);
-        next = (thread_t*) steque_pop(&ready_queue); 
+        if (voluntary)
+            LATENCY_READY(prev, YIELDED);
+        else
+            LATENCY_READY(prev, PREEMPTED);
     }
-    thread_t* prev = current;
-    steque_enqueue(&ready_queue, current);
-    next->state = GTTHREAD_RUNNING; 
+#endif
+    LATENCY_RUN(next);
+    sched_switches++;
+#if GTTHREAD_ENABLE_STATS
+    thread_account(prev, next, voluntary);
+#endif
     current = next;
+    if (runnext_chain == 0)
+        timer_dispatch(next);
+    if (sched_deterministic)
+        replay_switch(prev, next, voluntary);
+    TRACE(SWITCH, prev->tid, next->tid);
+    PROBE3(switch, prev->tid, next->tid, voluntary);
 
-    /* unblock the signal */
-    sigprocmask(SIG_UNBLOCK, &vtalrm, NULL); 
-    swapcontext(prev->ucp, current->ucp);
+    /* switch with the signal still blocked and unblock once resumed */
+    ctx_switch(prev, next);
+    TICKS_LEAVE();
+    VTALRM_UNBLOCK(); 
+
+    /* an asynchronous cancel request is acted on once we run again, but
+     * only if we gave up the CPU ourselves: a thread resumed from a tick
+     * is inside the signal handler, where running cleanup handlers and
+     * freeing memory is not safe */
+    if (voluntary && current->cancel_type == GTTHREAD_CANCEL_ASYNCHRONOUS)
+        gtthread_testcancel();
+    return 1;
 }
 
+#if GTTHREAD_ENABLE_STATS
 /*
- * Given a thread ID, search the thread in ready_queue and zombie queue 
- * This helper method is useful when we try to determine whether the thread
- * user wants to join is created before. 
+ * Charges the time since the last switch to the thread switched away
+ * from, as running, and to the thread switched to, as waiting; threads
+ * queued while they wait on a mutex or a join count as blocked instead.
+ */
+static void thread_account(thread_t* prev, thread_t* next, int voluntary)
+{
+    uint64_t now = clock_ticks();
+
+    if (voluntary)
+        prev->nvcsw++;
+    else
+        prev->nivcsw++;
+    prev->run_ticks += now - prev->since;
+    prev->since = now;
+    if (next->waiting != NULL || next->joining != 0)
+        next->blocked_ticks += now - next->since;
+    else
+        next->wait_ticks += now - next->since;
+    next->since = now;
+}
+#endif
+
+/*
+ * Given a thread ID, looks the thread up in the table of control blocks,
+ * which stay around after the thread has terminated. This helper method
+ * is useful when we try to determine whether the thread user wants to
+ * join is created before. 
  */
 thread_t* thread_get(gtthread_t tid)
 {
-    steque_node_t* current = ready_queue.front;   
-    while (current != NULL)
+    if (tid == 0 || tid >= maxtid)
+        return NULL;
+    return tids[tid];
+}
+
+/*
+ * Makes room in the thread table for n more threads, doubling it as
+ * needed. Returns -1 if out of memory. Must be called with SIGVTALRM
+ * blocked.
+ */
+static int tids_reserve(long n)
+{
+    size_t size = tids_size > 0 ? tids_size : 64;
+    thread_t** grown;
+
+    while (size < maxtid + (size_t) n)
+        size *= 2;
+    if (size == tids_size)
+        return 0;
+    grown = (thread_t**) realloc(tids, size * sizeof(thread_t*));
+    if (grown == NULL)
+        return -1;
+    tids = grown;
+    tids_size = size;
+    return 0;
+}
+
+void thread_foreach(void (*fn)(thread_t*, void*), void* arg)
+{
+    steque_node_t* node;
+    group_t* g;
+    thread_t* t;
+
+    (*fn)(current, arg);
+    for (g = &group_default; g != NULL; g = g->next)
+        for (t = g->queue.front; t != NULL; t = t->rq_next)
+            (*fn)(t, arg);
+    for (t = parked.front; t != NULL; t = t->rq_next)
+        (*fn)(t, arg);
+    for (node = zombie_queue.front; node != NULL; node = node->next)
+        (*fn)((thread_t*) node->item, arg);
+}
+
+/*
+ * Moves a live thread into group g, at the back of its ready queue if it
+ * is waiting to run. SIGVTALRM must be blocked.
+ */
+void thread_regroup(thread_t* t, group_t* g)
+{
+    int queued = t != current && !t->parked;
+
+    if (queued)
     {
-        thread_t* t= (thread_t*) current->item;
-        if (t->tid == tid)
-            return t;
-        current = current->next;
+        runq_remove(&t->group->queue, t);
+        ready_count--;
     }
+    t->group->members--;
+    t->group = g;
+    g->members++;
+    if (queued)
+        ready_enqueue(t);
+}
 
-    current = zombie_queue.front;
-    while (current != NULL)
+/*
+ * Makes a thread a daemon: the program ends once only daemon threads are
+ * left, as if they had been joined. SIGVTALRM must be blocked.
+ */
+void thread_daemon(thread_t* t)
+{
+    if (!t->daemon)
     {
-        thread_t* t= (thread_t*) current->item;
-        if (t->tid == tid)
-            return t;
-        current = current->next;
-    } 
-    return NULL;
+        t->daemon = 1;
+        daemons++;
+    }
 }
@@ -0,0 +1,80 @@
+/*
+ *  gtthread_sdt.h
+ *  gtthread
+ *
+ *  USDT probes for tracers such as bpftrace, perf and SystemTap, e.g.
+ *
+ *      bpftrace -e 'usdt:./main:gtthread:switch { @[arg0, arg1] = count(); }'
+ *
+ *  A probe is a nop in the code plus a .note.stapsdt entry telling the
+ *  tracer where the nop is and where to find the arguments; nothing runs
+ *  until a tracer patches the nop. <sys/sdt.h> is used when it is
+ *  installed. Otherwise, on x86_64, the same notes are emitted here;
+ *  elsewhere the probes compile to nothing.
+ */
+
+#ifndef __GTTHREAD_SDT_H
+#define __GTTHREAD_SDT_H
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define GTTHREAD_HAVE_SYS_SDT 1
+#endif
+#endif
+
+#if defined(GTTHREAD_HAVE_SYS_SDT)
+
+#include <sys/sdt.h>
+#define PROBE1(name, a1) STAP_PROBE1(gtthread, name, a1)
+#define PROBE2(name, a1, a2) STAP_PROBE2(gtthread, name, a1, a2)
+#define PROBE3(name, a1, a2, a3) STAP_PROBE3(gtthread, name, a1, a2, a3)
+
+#elif defined(__x86_64__) && defined(__GNUC__)
+
+/* the layout <sys/sdt.h> emits: the probe address, the base used to
+ * spot prelinking, no semaphore, then provider, name and the arguments,
+ * each as size@operand; all ours are passed as 8-byte signed values */
+#define SDT_NOTE(name, args) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte 0\n" \
+    ".asciz \"gtthread\"\n" \
+    ".asciz \"" #name "\"\n" \
+    ".asciz \"" args "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n"
+
+#define PROBE1(name, a1) \
+    __asm__ __volatile__ (SDT_NOTE(name, "-8@%[sdt1]") \
+        :: [sdt1] "nor" ((long) (a1)))
+#define PROBE2(name, a1, a2) \
+    __asm__ __volatile__ (SDT_NOTE(name, "-8@%[sdt1] -8@%[sdt2]") \
+        :: [sdt1] "nor" ((long) (a1)), [sdt2] "nor" ((long) (a2)))
+#define PROBE3(name, a1, a2, a3) \
+    __asm__ __volatile__ (SDT_NOTE(name, "-8@%[sdt1] -8@%[sdt2] -8@%[sdt3]") \
+        :: [sdt1] "nor" ((long) (a1)), [sdt2] "nor" ((long) (a2)), \
+           [sdt3] "nor" ((long) (a3)))
+
+#else
+
+#define PROBE1(name, a1) do { } while (0)
+#define PROBE2(name, a1, a2) do { } while (0)
+#define PROBE3(name, a1, a2, a3) do { } while (0)
+
+#endif
+
+#endif // __GTTHREAD_SDT_H
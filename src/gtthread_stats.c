@@ -0,0 +1,201 @@
+/**********************************************************************
+gtthread_stats.c.
+
+This file contains the per-thread statistics API. The scheduler charges
+the time between two switches to the threads involved as it switches,
+see thread_account in gtthread_sched.c; here the counts are turned into
+nanoseconds for gtthread_getstats and gtthread_dumpstats. Unless the
+library is built with GTTHREAD_ENABLE_STATS, both fail with ENOSYS.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+#if GTTHREAD_ENABLE_STATS
+/* what gtthread_dumpstats collects of a thread */
+typedef struct
+{
+    gtthread_t tid;
+    int state;
+    gtthread_stats_t stats;
+} stats_row_t;
+
+typedef struct
+{
+    stats_row_t* rows;
+    long n;
+    uint64_t now;
+} stats_table_t;
+
+static void stats_collect(thread_t* t, void* arg);
+static int stats_cmp(const void* a, const void* b);
+#endif
+
+double clock_ticks_per_us(void)
+{
+    static double rate;
+#if defined(__x86_64__) || defined(__i386__)
+    struct timespec t0, t1;
+    uint64_t c0, c1;
+    double us;
+
+    if (rate != 0)
+        return rate;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    c0 = clock_ticks();
+    do
+    {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        us = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+    } while (us < 2000);
+    c1 = clock_ticks();
+    rate = (c1 - c0) / us;
+#else
+    rate = 1000;
+#endif
+    return rate;
+}
+
+/*
+  Copies the statistics of a thread, running or terminated, into stats.
+  Returns -1 if there is no such thread.
+ */
+int gtthread_getstats(gtthread_t thread, gtthread_stats_t* stats)
+{
+#if GTTHREAD_ENABLE_STATS
+    thread_t* t;
+
+    clock_ticks_per_us();
+    VTALRM_BLOCK();
+    t = thread_current();
+    if (t->tid != thread)
+        t = thread_get(thread);
+    if (t == NULL)
+    {
+        VTALRM_UNBLOCK();
+        return -1;
+    }
+    thread_stats(t, stats, clock_ticks());
+    VTALRM_UNBLOCK();
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*
+  Writes the statistics of every thread to fd as a table, one thread per
+  line in ID order, followed by the totals. Returns -1 if the table
+  cannot be built.
+ */
+int gtthread_dumpstats(int fd)
+{
+#if GTTHREAD_ENABLE_STATS
+    stats_table_t table;
+    gtthread_stats_t total = {0, 0, 0, 0, 0, 0};
+    stats_row_t* r;
+    long i;
+
+    clock_ticks_per_us();
+    VTALRM_BLOCK();
+    table.rows = NULL;
+    table.n = 0;
+    thread_foreach(stats_collect, &table);
+    table.rows = (stats_row_t*) malloc(table.n * sizeof(stats_row_t));
+    if (table.rows == NULL)
+    {
+        VTALRM_UNBLOCK();
+        return -1;
+    }
+    table.n = 0;
+    table.now = clock_ticks();
+    thread_foreach(stats_collect, &table);
+    VTALRM_UNBLOCK();
+
+    qsort(table.rows, table.n, sizeof(stats_row_t), stats_cmp);
+    dprintf(fd, "%8s %-9s %12s %12s %12s %10s %11s %10s\n", "tid", "state",
+            "cpu_us", "wait_us", "blocked_us", "voluntary", "involuntary",
+            "preempted");
+    for (i = 0; i < table.n; i++)
+    {
+        r = &table.rows[i];
+        dprintf(fd, "%8lu %-9s %12llu %12llu %12llu %10lu %11lu %10lu\n",
+                r->tid,
+                r->state == GTTHREAD_RUNNING ? "running" :
+                r->state == GTTHREAD_CANCEL ? "cancelled" : "done",
+                r->stats.cpu_ns / 1000, r->stats.wait_ns / 1000,
+                r->stats.blocked_ns / 1000, r->stats.voluntary,
+                r->stats.involuntary, r->stats.preemptions);
+        total.cpu_ns += r->stats.cpu_ns;
+        total.wait_ns += r->stats.wait_ns;
+        total.blocked_ns += r->stats.blocked_ns;
+        total.voluntary += r->stats.voluntary;
+        total.involuntary += r->stats.involuntary;
+        total.preemptions += r->stats.preemptions;
+    }
+    dprintf(fd, "%8s %-9s %12llu %12llu %12llu %10lu %11lu %10lu\n", "total",
+            "", total.cpu_ns / 1000, total.wait_ns / 1000,
+            total.blocked_ns / 1000, total.voluntary, total.involuntary,
+            total.preemptions);
+    free(table.rows);
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+#if GTTHREAD_ENABLE_STATS
+
+void thread_stats(thread_t* t, gtthread_stats_t* out, uint64_t now)
+{
+    double rate = clock_ticks_per_us() / 1000;
+    uint64_t run = t->run_ticks;
+    uint64_t wait = t->wait_ticks;
+    uint64_t blocked = t->blocked_ticks;
+
+    if (t == thread_current())
+        run += now - t->since;
+    else if (t->state == GTTHREAD_RUNNING)
+    {
+        if (t->waiting != NULL || t->joining != 0)
+            blocked += now - t->since;
+        else
+            wait += now - t->since;
+    }
+
+    out->cpu_ns = run / rate;
+    out->wait_ns = wait / rate;
+    out->blocked_ns = blocked / rate;
+    out->voluntary = t->nvcsw;
+    out->involuntary = t->nivcsw;
+    out->preemptions = t->npreempt;
+}
+
+/* counts the threads on the first pass and fills the rows on the second */
+static void stats_collect(thread_t* t, void* arg)
+{
+    stats_table_t* table = (stats_table_t*) arg;
+
+    if (table->rows != NULL)
+    {
+        table->rows[table->n].tid = t->tid;
+        table->rows[table->n].state = t->state;
+        thread_stats(t, &table->rows[table->n].stats, table->now);
+    }
+    table->n++;
+}
+
+static int stats_cmp(const void* a, const void* b)
+{
+    gtthread_t x = ((const stats_row_t*) a)->tid;
+    gtthread_t y = ((const stats_row_t*) b)->tid;
+
+    return (x > y) - (x < y);
+}
+#endif
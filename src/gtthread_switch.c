@@ -0,0 +1,143 @@
+/**********************************************************************
+gtthread_switch.c.
+
+This file contains the context switch used on x86_64 in place of
+swapcontext. A switch between threads is always a function call made
+with SIGVTALRM blocked, so only what the ABI has a callee keep needs
+saving: rbx, rbp, r12 to r15, the stack pointer, and the control words
+of MXCSR and the x87 unit. The vector and x87 registers are caller-saved
+and dead across the call, so no FP, SSE or AVX state is saved whether
+the thread uses it or not; a thread preempted by a tick has its full
+state saved by the kernel in the signal frame instead. Neither is the
+signal mask switched, since every thread is switched with the same set
+blocked, which saves swapcontext's system call.
+
+The control words are saved on every switch, which is two stores, but
+only loaded when the thread switched to has different ones, as only
+threads that change the rounding mode or the exception masks do; ldmxcsr
+and fldcw are the slow part. The frame saved on a thread's stack is
+
+    sp[0]   MXCSR, and the x87 control word at byte 4
+    sp[1-6] r15, r14, r13, r12, rbx, rbp
+    sp[7]   where the thread resumes
+
+Building with GTTHREAD_UCONTEXT, or for another architecture, keeps
+swapcontext; see ctx_switch in gtthread_private.h.
+ **********************************************************************/
+
+#include <stdint.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+#if CTX_ASM
+/* the control words new threads start with, those of gtthread_init */
+static uint32_t ctx_control[2];
+
+/* where a thread that exits saves its frame, which is never resumed */
+static void* ctx_dead_sp;
+
+__asm__(
+    ".text\n"
+    ".globl ctx_swap\n"
+    ".type ctx_swap, @function\n"
+    "ctx_swap:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movl (%rsp), %eax\n"
+    "    movzwl 4(%rsp), %ecx\n"
+    "    movq %rsi, %rsp\n"
+    "    cmpl (%rsp), %eax\n"
+    "    je 1f\n"
+    "    ldmxcsr (%rsp)\n"
+    "1:  cmpw 4(%rsp), %cx\n"
+    "    je 2f\n"
+    "    fldcw 4(%rsp)\n"
+    "2:  addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size ctx_swap, .-ctx_swap\n"
+
+    /* a new thread's first switch returns here, with its start routine
+     * and argument in r12 and r13; unwinders stop at it */
+    ".type ctx_trampoline, @function\n"
+    "ctx_trampoline:\n"
+    "    .cfi_startproc\n"
+    "    .cfi_undefined rip\n"
+    "    movq %r12, %rdi\n"
+    "    movq %r13, %rsi\n"
+    "    call gtthread_start@PLT\n"
+    "    ud2\n"
+    "    .cfi_endproc\n"
+    ".size ctx_trampoline, .-ctx_trampoline\n"
+);
+
+void ctx_trampoline(void);
+
+/*
+ * Records the control words new threads start with. Called by
+ * gtthread_init.
+ */
+void ctx_setup(void)
+{
+    uint16_t cw;
+
+    __asm__ volatile ("stmxcsr %0" : "=m" (ctx_control[0]));
+    __asm__ volatile ("fnstcw %0" : "=m" (cw));
+    ctx_control[1] = cw;
+}
+
+/*
+ * Builds the frame a thread's first switch resumes from, at the top of
+ * the stack of its context, so that it calls gtthread_start with its
+ * start routine and argument.
+ */
+void ctx_init(thread_t* t)
+{
+    uintptr_t top = ((uintptr_t) t->ucp->uc_stack.ss_sp
+                     + t->ucp->uc_stack.ss_size) & ~(uintptr_t) 15;
+    /* the trampoline's call needs the stack 16-byte aligned */
+    uint64_t* sp = (uint64_t*) (top - 80);
+
+    sp[0] = ctx_control[0] | (uint64_t) ctx_control[1] << 32;
+    sp[1] = 0;
+    sp[2] = 0;
+    sp[3] = (uint64_t) t->arg;
+    sp[4] = (uint64_t) t->proc;
+    sp[5] = 0;
+    sp[6] = 0;
+    sp[7] = (uint64_t) &ctx_trampoline;
+    t->sp = sp;
+}
+
+/*
+ * Switches to a thread for good, from one that has exited.
+ */
+void ctx_jump(thread_t* next)
+{
+    ctx_swap(&ctx_dead_sp, next->sp);
+}
+
+/*
+ * Returns where a suspended thread resumes and its frame pointer there.
+ */
+void ctx_frame(thread_t* t, void** pc, uintptr_t** fp)
+{
+    uint64_t* sp = (uint64_t*) t->sp;
+
+    *pc = (void*) sp[7];
+    *fp = (uintptr_t*) sp[6];
+}
+#endif
@@ -0,0 +1,155 @@
+/**********************************************************************
+gtthread_ticks.c.
+
+This file contains the tick diagnostics, for choosing the quantum with
+data: how far apart the SIGVTALRM ticks actually arrive, how long it
+takes from a tick, or a yield or wait, until the next thread runs, and
+which share of the CPU the scheduler takes. The scheduler stamps the
+entry to a switch and the thread it switches to takes the time when it
+resumes, see TICKS_ENTER and TICKS_LEAVE. Built with
+GTTHREAD_ENABLE_TICKSTATS, a program writes the report to stderr when
+it exits, or to the file named by GTTHREAD_TICKSTATS; otherwise
+gtthread_dumpticks fails with ENOSYS.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+#if GTTHREAD_ENABLE_TICKSTATS
+static hist_t ticks_gap;        /* from one tick to the next */
+static hist_t ticks_cost;       /* from a tick to the next thread running */
+static hist_t ticks_switch;     /* from a yield or wait to the same */
+static uint64_t ticks_last;     /* the last tick */
+static uint64_t ticks_entry;    /* the switch under way, 0 if none */
+static int ticks_tick;          /* it was started by a tick */
+static long ticks_period;
+static double ticks_cpu0;       /* process CPU seconds at gtthread_init */
+
+static void ticks_atexit(void);
+static double ticks_cpu(void);
+static void ticks_row(int fd, const char* name, const hist_t* h, double rate);
+#endif
+
+/*
+  Writes the tick report to fd: the distribution of the intervals
+  between ticks, of the time from a tick or a voluntary switch until the
+  next thread runs, and the share of the CPU time since gtthread_init
+  spent switching. Returns -1 if it cannot be written.
+ */
+int gtthread_dumpticks(int fd)
+{
+#if GTTHREAD_ENABLE_TICKSTATS
+    double rate = clock_ticks_per_us() / 1000;
+    hist_t* h;
+    double cpu, tick_s, switch_s;
+
+    h = (hist_t*) malloc(3 * sizeof(hist_t));
+    if (h == NULL)
+        return -1;
+    VTALRM_BLOCK();
+    h[0] = ticks_gap;
+    h[1] = ticks_cost;
+    h[2] = ticks_switch;
+    VTALRM_UNBLOCK();
+
+    cpu = ticks_cpu() - ticks_cpu0;
+    tick_s = h[1].total / rate / 1e9;
+    switch_s = h[2].total / rate / 1e9;
+    dprintf(fd, "gtthread ticks: period %ldus, %llu ticks in %.3fs of CPU\n",
+            ticks_period, (unsigned long long) h[1].n, cpu);
+    dprintf(fd, "%-10s %10s %12s %12s %12s %12s %12s %12s\n", "", "count",
+            "mean_ns", "p50_ns", "p90_ns", "p99_ns", "p99.9_ns", "max_ns");
+    ticks_row(fd, "interval", &h[0], rate);
+    ticks_row(fd, "tick", &h[1], rate);
+    ticks_row(fd, "voluntary", &h[2], rate);
+    if (cpu > 0)
+        dprintf(fd, "scheduler: %.2f%% of the CPU, %.2f%% on ticks and "
+                "%.2f%% on voluntary switches\n",
+                100 * (tick_s + switch_s) / cpu, 100 * tick_s / cpu,
+                100 * switch_s / cpu);
+    free(h);
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+#if GTTHREAD_ENABLE_TICKSTATS
+/*
+ * Starts the measurement for a quantum of 'period' microseconds and has
+ * the report written at exit. Called by gtthread_init.
+ */
+void ticks_start(long period)
+{
+    ticks_period = period;
+    ticks_cpu0 = ticks_cpu();
+    clock_ticks_per_us();
+    ticks_last = clock_ticks();
+    atexit(ticks_atexit);
+}
+
+void ticks_enter(int sig)
+{
+    ticks_entry = clock_ticks();
+    ticks_tick = sig == SIGVTALRM;
+    if (ticks_tick)
+    {
+        hist_record(&ticks_gap, ticks_entry - ticks_last);
+        ticks_last = ticks_entry;
+    }
+}
+
+void ticks_leave(void)
+{
+    if (ticks_entry == 0)
+        return;
+    hist_record(ticks_tick ? &ticks_cost : &ticks_switch,
+                clock_ticks() - ticks_entry);
+    ticks_entry = 0;
+}
+
+static void ticks_atexit(void)
+{
+    const char* path = getenv("GTTHREAD_TICKSTATS");
+    int fd = STDERR_FILENO;
+
+    if (path != NULL && *path != '\0')
+    {
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            perror(path);
+            return;
+        }
+    }
+    gtthread_dumpticks(fd);
+    if (fd != STDERR_FILENO)
+        close(fd);
+}
+
+static double ticks_cpu(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void ticks_row(int fd, const char* name, const hist_t* h, double rate)
+{
+    dprintf(fd, "%-10s %10llu %12.0f %12.0f %12.0f %12.0f %12.0f %12.0f\n",
+            name, (unsigned long long) h->n,
+            h->n > 0 ? h->total / rate / h->n : 0,
+            hist_at(h, 0.5) / rate, hist_at(h, 0.9) / rate,
+            hist_at(h, 0.99) / rate, hist_at(h, 0.999) / rate,
+            h->max / rate);
+}
+#endif
@@ -0,0 +1,121 @@
+/**********************************************************************
+gtthread_trace.c.
+
+This file contains the scheduler tracer. It is off unless
+gtthread_trace_start is called or the GTTHREAD_TRACE environment
+variable names a file when gtthread_init runs. Events go into a ring
+mapped from that file, laid out as described in gtthread_trace.h, so
+they survive the program crashing. Unless the library is built with
+GTTHREAD_ENABLE_TRACE, gtthread_trace_start fails with ENOSYS.
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "gtthread.h"
+#include "gtthread_private.h"
+
+#define TRACE_DEFAULT_EVENTS (1L << 20)
+
+#if GTTHREAD_ENABLE_TRACE
+/* the mapped file, NULL while tracing is off */
+gtthread_trace_header_t* trace_file;
+static gtthread_trace_event_t* trace_ring;
+static size_t trace_size;
+#endif
+
+/*
+  Starts writing scheduler events to the file at path, creating or
+  truncating it. The ring keeps the last nevents events, rounded up to a
+  power of two; 0 picks the default of about a million. Returns 0 on
+  success and -1 if the file cannot be set up.
+ */
+int gtthread_trace_start(const char* path, long nevents)
+{
+#if GTTHREAD_ENABLE_TRACE
+    gtthread_trace_header_t* file;
+    uint64_t capacity = 1;
+    size_t size;
+    void* map;
+    int fd;
+
+    if (nevents <= 0)
+        nevents = TRACE_DEFAULT_EVENTS;
+    while (capacity < (uint64_t) nevents)
+        capacity <<= 1;
+    size = sizeof(gtthread_trace_header_t) + capacity * sizeof(gtthread_trace_event_t);
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    if (ftruncate(fd, size) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    file = (gtthread_trace_header_t*) map;
+    memcpy(file->magic, GTTHREAD_TRACE_MAGIC, sizeof(file->magic));
+    file->event_size = sizeof(gtthread_trace_event_t);
+    file->capacity = capacity;
+    file->head = 0;
+    file->ticks_per_us = clock_ticks_per_us();
+    file->start = clock_ticks();
+
+    gtthread_trace_stop();
+    VTALRM_BLOCK();
+    trace_ring = (gtthread_trace_event_t*) (file + 1);
+    trace_size = size;
+    trace_file = file;
+    VTALRM_UNBLOCK();
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*
+  Stops tracing and unmaps the file; the events recorded stay in it.
+ */
+void gtthread_trace_stop(void)
+{
+#if GTTHREAD_ENABLE_TRACE
+    gtthread_trace_header_t* file;
+
+    VTALRM_BLOCK();
+    file = trace_file;
+    trace_file = NULL;
+    VTALRM_UNBLOCK();
+
+    if (file != NULL)
+        munmap(file, trace_size);
+#endif
+}
+
+#if GTTHREAD_ENABLE_TRACE
+/*
+ * Appends an event to the ring. Called through the TRACE macro with
+ * SIGVTALRM blocked, so nothing else writes to the ring meanwhile.
+ */
+void trace_record(uint32_t type, gtthread_t tid, uint64_t arg)
+{
+    gtthread_trace_event_t* e;
+
+    e = &trace_ring[trace_file->head & (trace_file->capacity - 1)];
+    e->time = clock_ticks();
+    e->arg = arg;
+    e->tid = (uint32_t) tid;
+    e->type = type;
+    trace_file->head++;
+}
+#endif
@@ -78,6 +78,29 @@ void steque_cycle(steque_t* this){
   this->back->next = NULL;
 }
 
+int steque_remove(steque_t* this, steque_item item){
+  steque_node_t* prev;
+  steque_node_t* node;
+
+  prev = NULL;
+  for(node = this->front; node != NULL; prev = node, node = node->next){
+    if(node->item != item)
+      continue;
+
+    if(prev == NULL)
+      this->front = node->next;
+    else
+      prev->next = node->next;
+    if(this->back == node)
+      this->back = prev;
+    free(node);
+
+    this->N--;
+    return 1;
+  }
+  return 0;
+}
+
 steque_item steque_front(steque_t* this){
   if(this->front == NULL){
     fprintf(stderr, "Error: underflow in steque_front.\n");
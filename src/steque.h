@@ -36,6 +36,9 @@ steque_item steque_pop(steque_t* this);
 /* Removes the element on the "front" to the "back" of the steque */
 void steque_cycle(steque_t* this);
 
+/* Removes the first occurrence of item; returns 1 if found, 0 otherwise */
+int steque_remove(steque_t* this, steque_item item);
+
 /* Returns the element at the "front" of the steque without removing it*/
 steque_item steque_front(steque_t* this);
 
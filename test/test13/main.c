@@ -0,0 +1,113 @@
+// Test13
+// Cancellation and cleanup handlers. A cancelled thread must release the
+// mutex it holds through its cleanup handler. A thread, deferred by
+// default, must only be cancelled at a cancellation point, and an
+// asynchronous one when it yields. A thread cancelled before it ever ran
+// must not run at all.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gtthread.h>
+
+gtthread_mutex_t g_mutex;
+int g_cleaned = 0;
+int g_reached = 0;
+int g_started = 0;
+
+void unlock_mutex(void* arg)
+{
+	gtthread_mutex_unlock((gtthread_mutex_t*) arg);
+	g_cleaned++;
+}
+
+void* holder(void* arg)
+{
+	char* buf = malloc(64);
+
+	if (gtthread_cleanup_push(free, buf) != 0)
+		fprintf(stderr, "!ERROR! Cleanup handler not pushed\n");
+	gtthread_mutex_lock(&g_mutex);
+	gtthread_cleanup_push(unlock_mutex, &g_mutex);
+	while(1)
+		gtthread_testcancel();
+	gtthread_cleanup_pop(1);
+	gtthread_cleanup_pop(1);
+	return NULL;
+}
+
+void* deferred(void* arg)
+{
+	int i;
+
+	for(i = 0; i < 10; i++)
+		gtthread_yield();
+	g_reached = 1;
+	while(1)
+		gtthread_testcancel();
+	return NULL;
+}
+
+void* asynchronous(void* arg)
+{
+	gtthread_setcanceltype(GTTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+	while(1)
+		gtthread_yield();
+	return NULL;
+}
+
+void* never(void* arg)
+{
+	g_started = 1;
+	return NULL;
+}
+
+int main()
+{
+	gtthread_t th1, th2, th3, th4;
+	void* ret;
+
+	gtthread_init(1000);
+	gtthread_mutex_init(&g_mutex);
+
+	gtthread_create(&th1, holder, NULL);
+	gtthread_yield();
+	gtthread_cancel(th1);
+	gtthread_join(th1, &ret);
+
+	if (ret != GTTHREAD_CANCELED)
+		fprintf(stderr, "!ERROR! Wrong status! %p\n", ret);
+	if (g_cleaned != 1)
+		fprintf(stderr, "!ERROR! Cleanup handler ran %d times\n", g_cleaned);
+
+	/* the lock must be free again */
+	gtthread_mutex_lock(&g_mutex);
+	gtthread_mutex_unlock(&g_mutex);
+
+	gtthread_create(&th2, deferred, NULL);
+	gtthread_yield();
+	gtthread_cancel(th2);
+	gtthread_join(th2, &ret);
+
+	if (ret != GTTHREAD_CANCELED || !g_reached)
+		fprintf(stderr, "!ERROR! Deferred thread cancelled too early\n");
+
+	gtthread_create(&th4, asynchronous, NULL);
+	gtthread_yield();
+	gtthread_cancel(th4);
+	gtthread_join(th4, &ret);
+
+	if (ret != GTTHREAD_CANCELED)
+		fprintf(stderr, "!ERROR! Asynchronous thread not cancelled\n");
+
+	/* a thread cancelled before it ever ran must never start */
+	gtthread_create(&th3, never, NULL);
+	gtthread_cancel(th3);
+	gtthread_join(th3, &ret);
+
+	if (ret != GTTHREAD_CANCELED || g_started)
+		fprintf(stderr, "!ERROR! Pending thread was started\n");
+
+	gtthread_mutex_destroy(&g_mutex);
+	printf("done\n");
+	return 0;
+}
@@ -0,0 +1,56 @@
+// Test14
+// gtthread_create_n. Every thread of a batch must get its own argument
+// through the stride and be joinable like a normally created thread. A
+// negative batch, or one too large to size, must be refused.
+
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <gtthread.h>
+
+#define NUM_THREADS 100
+
+long g_args[NUM_THREADS];
+
+void* worker(void* arg)
+{
+	return (void*) (*(long*) arg * 2);
+}
+
+int main()
+{
+	gtthread_t threads[NUM_THREADS];
+	void* ret;
+	int i;
+
+	gtthread_init(1000);
+
+	for (i = 0; i < NUM_THREADS; ++i)
+		g_args[i] = i;
+
+	/* run the batch twice so the first one's memory is released */
+	gtthread_create_n(threads, NUM_THREADS, worker, g_args, sizeof(long));
+	for (i = 0; i < NUM_THREADS; ++i) {
+		gtthread_join(threads[i], &ret);
+		if ((long) ret != i * 2) {
+			fprintf(stderr,
+					"!ERROR! %dth return value is wrong! %ld\n",
+					i, (long) ret);
+		}
+	}
+
+	gtthread_create_n(threads, NUM_THREADS, worker, g_args, 0);
+	for (i = 0; i < NUM_THREADS; ++i) {
+		gtthread_join(threads[i], &ret);
+		if ((long) ret != 0)
+			fprintf(stderr, "!ERROR! stride 0 gave %ld\n", (long) ret);
+	}
+
+	errno = 0;
+	if (gtthread_create_n(threads, LONG_MAX, worker, g_args, 0) != -1 || errno != EINVAL)
+		fprintf(stderr, "!ERROR! Oversized batch accepted\n");
+	errno = 0;
+	if (gtthread_create_n(threads, -1, worker, g_args, 0) != -1 || errno != EINVAL)
+		fprintf(stderr, "!ERROR! Negative batch accepted\n");
+	return 0;
+}
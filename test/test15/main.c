@@ -0,0 +1,104 @@
+// Test15
+// Scheduler tracing, when the library is built with it. Two threads
+// contend for a mutex while yielding; the trace must hold their creation,
+// exit, lock wait and handoff, and its switch events must chain, each
+// starting on the thread the previous one switched to.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <gtthread.h>
+#include <gtthread_trace.h>
+
+#define TRACE_PATH "/tmp/gtthread_test15.trace"
+
+gtthread_mutex_t g_mutex;
+
+void* worker(void* arg)
+{
+	int i;
+
+	for(i = 0; i < 5; i++)
+	{
+		gtthread_mutex_lock(&g_mutex);
+		gtthread_yield();
+		gtthread_mutex_unlock(&g_mutex);
+		gtthread_yield();
+	}
+	return NULL;
+}
+
+int main()
+{
+	gtthread_t th1, th2;
+	gtthread_trace_header_t header;
+	gtthread_trace_event_t* events;
+	long count[GTTHREAD_TRACE_JOIN + 1] = {0};
+	uint64_t i, running = 1;
+	FILE* f;
+
+	gtthread_init(1000);
+	gtthread_mutex_init(&g_mutex);
+	if (gtthread_trace_start(TRACE_PATH, 4096) != 0)
+	{
+		/* built without GTTHREAD_ENABLE_TRACE */
+		if (errno == ENOSYS)
+		{
+			printf("done\n");
+			return 0;
+		}
+		fprintf(stderr, "!ERROR! Cannot start the trace\n");
+		return 1;
+	}
+
+	gtthread_create(&th1, worker, NULL);
+	gtthread_create(&th2, worker, NULL);
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+	gtthread_trace_stop();
+
+	f = fopen(TRACE_PATH, "rb");
+	if (f == NULL || fread(&header, sizeof(header), 1, f) != 1
+	    || memcmp(header.magic, GTTHREAD_TRACE_MAGIC, 8) != 0
+	    || header.head > header.capacity)
+	{
+		fprintf(stderr, "!ERROR! Bad trace header\n");
+		return 1;
+	}
+	events = malloc(header.head * sizeof(gtthread_trace_event_t));
+	if (fread(events, sizeof(gtthread_trace_event_t), header.head, f) != header.head)
+		fprintf(stderr, "!ERROR! Short trace\n");
+	fclose(f);
+	unlink(TRACE_PATH);
+
+	for(i = 0; i < header.head; i++)
+	{
+		if (events[i].type > GTTHREAD_TRACE_JOIN)
+			fprintf(stderr, "!ERROR! Bad event type %u\n", events[i].type);
+		else
+			count[events[i].type]++;
+		if (events[i].type == GTTHREAD_TRACE_SWITCH)
+		{
+			if (events[i].tid != running)
+				fprintf(stderr, "!ERROR! Switch from %u while %lu runs\n",
+				        events[i].tid, (unsigned long) running);
+			running = events[i].arg;
+		}
+	}
+
+	if (count[GTTHREAD_TRACE_CREATE] != 2 || count[GTTHREAD_TRACE_EXIT] != 2)
+		fprintf(stderr, "!ERROR! Missing create or exit events\n");
+	if (count[GTTHREAD_TRACE_LOCK] != 10 || count[GTTHREAD_TRACE_UNLOCK] != 10)
+		fprintf(stderr, "!ERROR! Missing lock events\n");
+	if (count[GTTHREAD_TRACE_LOCK_WAIT] == 0 || count[GTTHREAD_TRACE_WAKEUP] == 0)
+		fprintf(stderr, "!ERROR! No lock contention recorded\n");
+	if (count[GTTHREAD_TRACE_JOIN] != 2)
+		fprintf(stderr, "!ERROR! Missing join events\n");
+
+	free(events);
+	gtthread_mutex_destroy(&g_mutex);
+	printf("done\n");
+	return 0;
+}
@@ -0,0 +1,85 @@
+// Test16
+// Per-thread statistics, when the library is built with them. A thread
+// that spins must be charged CPU time and be switched away from by ticks,
+// one that yields must be counted as switching voluntarily, and one that
+// waits for a mutex held by the main thread must be charged blocked time.
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <gtthread.h>
+
+gtthread_mutex_t g_mutex;
+volatile int g_stop = 0;
+
+void* spinner(void* arg)
+{
+	while(!g_stop);
+	return NULL;
+}
+
+void* yielder(void* arg)
+{
+	int i;
+
+	for(i = 0; i < 100; i++)
+		gtthread_yield();
+	return NULL;
+}
+
+void* locker(void* arg)
+{
+	gtthread_mutex_lock(&g_mutex);
+	gtthread_mutex_unlock(&g_mutex);
+	return NULL;
+}
+
+int main()
+{
+	gtthread_t th1, th2, th3;
+	gtthread_stats_t st;
+	long i;
+
+	gtthread_init(1000);
+	if (gtthread_getstats(gtthread_self(), &st) != 0 && errno == ENOSYS)
+	{
+		printf("done\n");
+		return 0;
+	}
+	gtthread_mutex_init(&g_mutex);
+	gtthread_mutex_lock(&g_mutex);
+
+	gtthread_create(&th1, spinner, NULL);
+	gtthread_create(&th2, yielder, NULL);
+	gtthread_create(&th3, locker, NULL);
+
+	/* burn enough CPU for several ticks while the others run */
+	for(i = 0; i < 20; i++)
+	{
+		volatile long j;
+		for(j = 0; j < 2000000; j++);
+		gtthread_yield();
+	}
+	gtthread_mutex_unlock(&g_mutex);
+	g_stop = 1;
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+	gtthread_join(th3, NULL);
+
+	if (gtthread_getstats(th1, &st) != 0 || st.cpu_ns == 0 || st.involuntary == 0
+	    || st.preemptions < st.involuntary)
+		fprintf(stderr, "!ERROR! Spinner was not preempted\n");
+	if (gtthread_getstats(th2, &st) != 0 || st.voluntary < 100 || st.wait_ns == 0)
+		fprintf(stderr, "!ERROR! Yields not counted: %lu\n", st.voluntary);
+	if (gtthread_getstats(th3, &st) != 0 || st.blocked_ns == 0)
+		fprintf(stderr, "!ERROR! Lock wait not counted\n");
+	if (gtthread_getstats(gtthread_self(), &st) != 0 || st.cpu_ns == 0)
+		fprintf(stderr, "!ERROR! Main thread has no CPU time\n");
+	if (gtthread_getstats(12345, &st) != -1)
+		fprintf(stderr, "!ERROR! Stats for a thread that does not exist\n");
+
+	gtthread_dumpstats(STDOUT_FILENO);
+	gtthread_mutex_destroy(&g_mutex);
+	printf("done\n");
+	return 0;
+}
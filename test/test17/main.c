@@ -0,0 +1,83 @@
+// Test17
+// Thread dump. With one thread blocked on a mutex, one joining it and one
+// not started yet, the dump triggered by SIGUSR1 must list each of them
+// with what it waits on and a backtrace.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <gtthread.h>
+
+gtthread_mutex_t g_mutex;
+gtthread_t g_locker;
+
+void* locker(void* arg)
+{
+	gtthread_mutex_lock(&g_mutex);
+	gtthread_mutex_unlock(&g_mutex);
+	return NULL;
+}
+
+void* joiner(void* arg)
+{
+	gtthread_join(g_locker, NULL);
+	return NULL;
+}
+
+void* idle(void* arg)
+{
+	return NULL;
+}
+
+int main()
+{
+	gtthread_t th2, th3;
+	char buf[8192];
+	char want[64];
+	int fds[2];
+	ssize_t n;
+
+	gtthread_init(1000);
+	gtthread_mutex_init(&g_mutex);
+	if (pipe(fds) != 0 || gtthread_dump_on_signal(SIGUSR1, fds[1]) != 0)
+	{
+		fprintf(stderr, "!ERROR! Cannot install the dump handler\n");
+		return 1;
+	}
+
+	gtthread_mutex_lock(&g_mutex);
+	gtthread_create(&g_locker, locker, NULL);
+	gtthread_create(&th2, joiner, NULL);
+	gtthread_yield();
+	gtthread_yield();
+	gtthread_create(&th3, idle, NULL);
+
+	raise(SIGUSR1);
+	close(fds[1]);
+	n = read(fds[0], buf, sizeof(buf) - 1);
+	buf[n > 0 ? n : 0] = '\0';
+
+	if (strstr(buf, "thread 1: running") == NULL)
+		fprintf(stderr, "!ERROR! Running thread missing\n");
+	snprintf(want, sizeof(want), "thread %lu: blocked on mutex %p", g_locker, (void*) &g_mutex);
+	if (strstr(buf, want) == NULL)
+		fprintf(stderr, "!ERROR! Blocked thread missing\n");
+	snprintf(want, sizeof(want), "thread %lu: joining thread %lu", th2, g_locker);
+	if (strstr(buf, want) == NULL)
+		fprintf(stderr, "!ERROR! Joining thread missing\n");
+	snprintf(want, sizeof(want), "thread %lu: not started", th3);
+	if (strstr(buf, want) == NULL)
+		fprintf(stderr, "!ERROR! New thread missing\n");
+	if (strstr(buf, "[0x") == NULL)
+		fprintf(stderr, "!ERROR! No backtrace\n");
+
+	gtthread_mutex_unlock(&g_mutex);
+	gtthread_join(g_locker, NULL);
+	gtthread_join(th2, NULL);
+	gtthread_join(th3, NULL);
+	gtthread_mutex_destroy(&g_mutex);
+	printf("done\n");
+	return 0;
+}
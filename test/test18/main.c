@@ -0,0 +1,83 @@
+// Test18
+// Sampling profiler. Two threads burn CPU; whether the samples are taken
+// on the tick or on the profiling timer, the folded output must attribute
+// stacks to each of them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <gtthread.h>
+
+#define PROF_PATH "/tmp/gtthread_test18.folded"
+
+void* burn(void* arg)
+{
+	volatile long i;
+
+	for(i = 0; i < 30000000; i++);
+	return NULL;
+}
+
+int check(long period)
+{
+	gtthread_t th1, th2;
+	char want[64];
+	char* buf;
+	long count, total = 0;
+	char* line;
+	int fd;
+	FILE* f;
+
+	if (gtthread_prof_start(period, 0) != 0)
+	{
+		fprintf(stderr, "!ERROR! Cannot start the profiler\n");
+		return 1;
+	}
+	gtthread_create(&th1, burn, NULL);
+	gtthread_create(&th2, burn, NULL);
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+	gtthread_prof_stop();
+
+	fd = open(PROF_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	gtthread_prof_write(fd);
+	close(fd);
+
+	buf = malloc(1 << 20);
+	f = fopen(PROF_PATH, "r");
+	count = fread(buf, 1, (1 << 20) - 1, f);
+	buf[count] = '\0';
+	fclose(f);
+	unlink(PROF_PATH);
+
+	snprintf(want, sizeof(want), ";gtthread %lu;", th1);
+	if (strstr(buf, want) == NULL)
+		fprintf(stderr, "!ERROR! No samples for thread %lu\n", th1);
+	snprintf(want, sizeof(want), ";gtthread %lu;", th2);
+	if (strstr(buf, want) == NULL)
+		fprintf(stderr, "!ERROR! No samples for thread %lu\n", th2);
+
+	/* every line ends in its count */
+	for(line = strtok(buf, "\n"); line != NULL; line = strtok(NULL, "\n"))
+	{
+		if (strrchr(line, ' ') == NULL || (count = atol(strrchr(line, ' ') + 1)) <= 0)
+			fprintf(stderr, "!ERROR! Bad line: %s\n", line);
+		else
+			total += count;
+	}
+	if (total < 10)
+		fprintf(stderr, "!ERROR! Only %ld samples\n", total);
+	free(buf);
+	return 0;
+}
+
+int main()
+{
+	gtthread_init(1000);
+	check(0);
+	check(1000);
+	printf("done\n");
+	return 0;
+}
@@ -0,0 +1,83 @@
+// Test19
+// Lock profiling, when the library is built with it. A mutex the workers
+// fight over must show up as contended, ahead of one only main takes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <gtthread.h>
+
+gtthread_mutex_t g_busy;
+gtthread_mutex_t g_quiet;
+
+void* worker(void* arg)
+{
+	int i;
+
+	for(i = 0; i < 10; i++)
+	{
+		gtthread_mutex_lock(&g_busy);
+		gtthread_yield();
+		gtthread_mutex_unlock(&g_busy);
+	}
+	return NULL;
+}
+
+int main()
+{
+	gtthread_t th1, th2;
+	char buf[4096];
+	char busy[32], quiet[32];
+	char* line;
+	char* b;
+	char* q;
+	unsigned long acquired, contended;
+	int fds[2];
+	ssize_t n;
+
+	gtthread_init(1000);
+	gtthread_mutex_init(&g_busy);
+	gtthread_mutex_init(&g_quiet);
+	gtthread_mutex_lock(&g_quiet);
+	gtthread_mutex_unlock(&g_quiet);
+
+	gtthread_create(&th1, worker, NULL);
+	gtthread_create(&th2, worker, NULL);
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+
+	if (pipe(fds) != 0)
+		return 1;
+	if (gtthread_lockprof_dump(fds[1]) != 0)
+	{
+		/* built without GTTHREAD_ENABLE_LOCKPROF */
+		if (errno != ENOSYS)
+			fprintf(stderr, "!ERROR! Cannot dump the lock profile\n");
+		printf("done\n");
+		return 0;
+	}
+	close(fds[1]);
+	n = read(fds[0], buf, sizeof(buf) - 1);
+	buf[n > 0 ? n : 0] = '\0';
+
+	snprintf(busy, sizeof(busy), "\n%p ", (void*) &g_busy);
+	snprintf(quiet, sizeof(quiet), "\n%p ", (void*) &g_quiet);
+	b = strstr(buf, busy);
+	q = strstr(buf, quiet);
+	if (b == NULL || q == NULL || b > q)
+		fprintf(stderr, "!ERROR! Mutexes missing or out of order\n%s", buf);
+	else
+	{
+		line = b + strlen(busy);
+		if (sscanf(line, "%lu %lu", &acquired, &contended) != 2
+		    || acquired != 20 || contended == 0)
+			fprintf(stderr, "!ERROR! Wrong counts for the busy mutex\n%s", buf);
+	}
+
+	gtthread_mutex_destroy(&g_busy);
+	gtthread_mutex_destroy(&g_quiet);
+	printf("done\n");
+	return 0;
+}
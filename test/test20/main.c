@@ -0,0 +1,111 @@
+// Test20
+// Metrics endpoint. A scrape over the Unix socket must get an HTTP reply
+// with the scheduler metrics while the other threads keep running, and
+// the server must not keep the program alive once main exits.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <gtthread.h>
+
+gtthread_mutex_t g_mutex;
+volatile long g_spins;
+volatile int g_stop;
+
+void* spinner(void* arg)
+{
+	while (!g_stop)
+		g_spins++;
+	return NULL;
+}
+
+void* locker(void* arg)
+{
+	gtthread_mutex_lock(&g_mutex);
+	gtthread_mutex_unlock(&g_mutex);
+	return NULL;
+}
+
+/* fetches the metrics into buf without blocking the other threads */
+int scrape(const char* path, char* buf, size_t size)
+{
+	struct sockaddr_un addr;
+	const char* req = "GET /metrics HTTP/1.0\r\n\r\n";
+	size_t n = 0;
+	ssize_t r;
+	int fd;
+
+	memset(&addr, '\0', sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0
+	    || write(fd, req, strlen(req)) < 0)
+		return -1;
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	while (n < size - 1)
+	{
+		r = read(fd, buf + n, size - 1 - n);
+		if (r > 0)
+			n += r;
+		else if (r == 0 || errno != EAGAIN)
+			break;
+		else
+			gtthread_yield();
+	}
+	buf[n] = '\0';
+	close(fd);
+	return 0;
+}
+
+int main()
+{
+	gtthread_t th1, th2;
+	char path[64];
+	char buf[8192];
+	long before;
+
+	gtthread_init(1000);
+	gtthread_mutex_init(&g_mutex);
+	snprintf(path, sizeof(path), "/tmp/gtthread_test20.%d", (int) getpid());
+	if (gtthread_metrics_start(path) != 0)
+	{
+		fprintf(stderr, "!ERROR! Cannot start the metrics server\n");
+		return 1;
+	}
+
+	gtthread_mutex_lock(&g_mutex);
+	gtthread_create(&th1, spinner, NULL);
+	gtthread_create(&th2, locker, NULL);
+	gtthread_yield();
+
+	before = g_spins;
+	if (scrape(path, buf, sizeof(buf)) != 0)
+		fprintf(stderr, "!ERROR! Cannot connect to %s\n", path);
+	else if (strncmp(buf, "HTTP/1.0 200", 12) != 0
+	         || strstr(buf, "\ngtthread_switches_total ") == NULL
+	         || strstr(buf, "\ngtthread_run_queue_length ") == NULL
+	         || strstr(buf, "\ngtthread_threads{state=\"blocked\"} 1\n") == NULL
+	         || strstr(buf, "\ngtthread_stack_bytes ") == NULL
+	         || strstr(buf, "\ngtthread_mutex_waiters{mutex=") == NULL)
+		fprintf(stderr, "!ERROR! Wrong metrics\n%s", buf);
+	if (g_spins == before)
+		fprintf(stderr, "!ERROR! The scrape stopped the other threads\n");
+
+	g_stop = 1;
+	gtthread_mutex_unlock(&g_mutex);
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+	gtthread_mutex_destroy(&g_mutex);
+
+	/* the server is still running, and must not keep us here */
+	unlink(path);
+	printf("done\n");
+	gtthread_exit(NULL);
+	return 0;
+}
@@ -0,0 +1,73 @@
+// Test21
+// Scheduling latency histograms, when the library is built with them.
+// Created threads, yields and a mutex handoff must each be recorded in
+// their own class, with ordered percentiles.
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <gtthread.h>
+
+gtthread_mutex_t g_mutex;
+
+void* yielder(void* arg)
+{
+	int i;
+
+	for(i = 0; i < 100; i++)
+		gtthread_yield();
+	return NULL;
+}
+
+void* locker(void* arg)
+{
+	gtthread_mutex_lock(&g_mutex);
+	gtthread_mutex_unlock(&g_mutex);
+	return NULL;
+}
+
+int main()
+{
+	gtthread_t th[4], lk;
+	gtthread_latency_t l;
+	int i;
+
+	gtthread_init(1000);
+	if (gtthread_getlatency(GTTHREAD_LATENCY_NEW, &l) != 0 && errno == ENOSYS)
+	{
+		printf("done\n");
+		return 0;
+	}
+	gtthread_mutex_init(&g_mutex);
+	gtthread_mutex_lock(&g_mutex);
+
+	for(i = 0; i < 4; i++)
+		gtthread_create(&th[i], yielder, NULL);
+	gtthread_create(&lk, locker, NULL);
+	gtthread_yield();
+	gtthread_mutex_unlock(&g_mutex);
+	for(i = 0; i < 4; i++)
+		gtthread_join(th[i], NULL);
+	gtthread_join(lk, NULL);
+
+	if (gtthread_getlatency(GTTHREAD_LATENCY_NEW, &l) != 0 || l.count != 5)
+		fprintf(stderr, "!ERROR! Expected 5 new threads, got %llu\n", l.count);
+	if (gtthread_getlatency(GTTHREAD_LATENCY_YIELDED, &l) != 0 || l.count < 400
+	    || l.p50_ns > l.p90_ns || l.p90_ns > l.p99_ns || l.p99_ns > l.p999_ns
+	    || l.p999_ns > l.max_ns || l.max_ns == 0)
+		fprintf(stderr, "!ERROR! Wrong yield latencies: %llu %llu %llu %llu\n",
+		        l.count, l.p50_ns, l.p99_ns, l.max_ns);
+	if (gtthread_getlatency(GTTHREAD_LATENCY_WOKEN, &l) != 0 || l.count < 2)
+		fprintf(stderr, "!ERROR! Mutex and join wakeups not recorded\n");
+	if (gtthread_getlatency(GTTHREAD_LATENCY_CLASSES, &l) != -1)
+		fprintf(stderr, "!ERROR! Latency of a class that does not exist\n");
+
+	gtthread_dumplatency(STDOUT_FILENO);
+	gtthread_resetlatency();
+	if (gtthread_getlatency(GTTHREAD_LATENCY_YIELDED, &l) != 0 || l.count != 0)
+		fprintf(stderr, "!ERROR! Histograms not reset\n");
+
+	gtthread_mutex_destroy(&g_mutex);
+	printf("done\n");
+	return 0;
+}
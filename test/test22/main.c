@@ -0,0 +1,71 @@
+// Test22
+// Tick diagnostics, when the library is built with them. Spinning
+// threads must see ticks arrive and be switched, and yields must be
+// counted as voluntary switches.
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <gtthread.h>
+
+volatile int g_stop = 0;
+
+void* spinner(void* arg)
+{
+	while(!g_stop);
+	return NULL;
+}
+
+int main()
+{
+	gtthread_t th1, th2;
+	char buf[4096];
+	unsigned long long ticks = 0, gaps = 0, yields = 0;
+	char* line;
+	int fds[2];
+	ssize_t n;
+	long i;
+
+	gtthread_init(1000);
+	if (pipe(fds) != 0)
+		return 1;
+	if (gtthread_dumpticks(fds[1]) != 0)
+	{
+		/* built without GTTHREAD_ENABLE_TICKSTATS */
+		if (errno != ENOSYS)
+			fprintf(stderr, "!ERROR! Cannot write the tick report\n");
+		printf("done\n");
+		return 0;
+	}
+	n = read(fds[0], buf, sizeof(buf) - 1);
+
+	gtthread_create(&th1, spinner, NULL);
+	gtthread_create(&th2, spinner, NULL);
+	for(i = 0; i < 20; i++)
+	{
+		volatile long j;
+		for(j = 0; j < 2000000; j++);
+		gtthread_yield();
+	}
+	g_stop = 1;
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+
+	gtthread_dumpticks(fds[1]);
+	close(fds[1]);
+	n = read(fds[0], buf, sizeof(buf) - 1);
+	buf[n > 0 ? n : 0] = '\0';
+	if ((line = strstr(buf, "\ninterval ")) != NULL)
+		sscanf(line + 10, "%llu", &gaps);
+	if ((line = strstr(buf, "\ntick ")) != NULL)
+		sscanf(line + 6, "%llu", &ticks);
+	if ((line = strstr(buf, "\nvoluntary ")) != NULL)
+		sscanf(line + 11, "%llu", &yields);
+	if (ticks == 0 || gaps != ticks || yields < 20
+	    || strstr(buf, "\nscheduler: ") == NULL)
+		fprintf(stderr, "!ERROR! Wrong tick report\n%s", buf);
+
+	printf("done\n");
+	return 0;
+}
@@ -0,0 +1,75 @@
+// Test23
+// Adaptive quantum. Bad bounds must be refused, the period must stay
+// within the bounds, grow while two threads only spin, shrink while a
+// thread that yields early queues behind a spinner, and go back to the
+// period given to gtthread_init when the tuning is turned off.
+
+#include <stdio.h>
+#include <gtthread.h>
+
+volatile int g_stop = 0;
+
+void* spinner(void* arg)
+{
+	while(!g_stop);
+	return NULL;
+}
+
+void* yielder(void* arg)
+{
+	while(!g_stop)
+	{
+		volatile long j;
+		for(j = 0; j < 1000; j++);
+		gtthread_yield();
+	}
+	return NULL;
+}
+
+/* burns CPU until the quantum passes limit in the given direction */
+int wait_quantum(long limit, int up)
+{
+	long i;
+
+	for(i = 0; i < 400; i++)
+	{
+		volatile long j;
+		for(j = 0; j < 500000; j++);
+		if (up ? gtthread_get_quantum() >= limit : gtthread_get_quantum() <= limit)
+			return 1;
+	}
+	return 0;
+}
+
+int main()
+{
+	gtthread_t th1, th2;
+
+	gtthread_init(2000);
+	if (gtthread_adapt_quantum(0, 1000) != -1 || gtthread_adapt_quantum(2000, 1000) != -1)
+		fprintf(stderr, "!ERROR! Bad bounds accepted\n");
+	if (gtthread_adapt_quantum(1000, 16000) != 0)
+		fprintf(stderr, "!ERROR! Cannot adapt the quantum\n");
+
+	/* batch: main and a spinner use up their slices */
+	gtthread_create(&th1, spinner, NULL);
+	if (!wait_quantum(8000, 1))
+		fprintf(stderr, "!ERROR! Quantum did not grow: %ld\n", gtthread_get_quantum());
+
+	/* a thread that yields early now waits behind the spinners */
+	gtthread_create(&th2, yielder, NULL);
+	if (!wait_quantum(4000, 0))
+		fprintf(stderr, "!ERROR! Quantum did not shrink: %ld\n", gtthread_get_quantum());
+	if (gtthread_get_quantum() < 1000 || gtthread_get_quantum() > 16000)
+		fprintf(stderr, "!ERROR! Quantum out of bounds: %ld\n", gtthread_get_quantum());
+
+	g_stop = 1;
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+	gtthread_adapt_quantum(0, 0);
+	if (gtthread_get_quantum() != 2000)
+		fprintf(stderr, "!ERROR! Quantum not restored: %ld\n", gtthread_get_quantum());
+
+	printf("done\n");
+	return 0;
+}
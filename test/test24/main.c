@@ -0,0 +1,104 @@
+// Test24
+// Per-thread quantum. Of two spinning threads, the one given a long
+// quantum must run in much longer slices than the one on the default,
+// and a quantum cannot be set on a thread that does not exist.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <gtthread.h>
+
+#define SLICES 6
+
+typedef struct
+{
+	int id;
+	int n;
+	double slices[SLICES];
+} slices_t;
+
+/* spinners with all their slices, which keep spinning for the others */
+volatile int g_full;
+/* the spinner that ran last; a change of owner marks a real switch */
+volatile int g_last;
+
+/* process CPU time, which stands still while the kernel runs others */
+double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* spins, timing the stretches it runs before the other spinner takes over */
+void* spinner(void* arg)
+{
+	slices_t* s = (slices_t*) arg;
+	double start = 0, last = 0, t;
+	int running = 0;
+	volatile int i;
+
+	while (g_full < 2)
+	{
+		/* reading the clock is a system call, which ITIMER_VIRTUAL does
+		   not count; spin in user mode in between so the quantum runs out */
+		for (i = 0; i < 10000; i++)
+			;
+		t = now();
+		if (g_last != s->id)
+		{
+			if (running && s->n < SLICES)
+			{
+				s->slices[s->n++] = last - start;
+				if (s->n == SLICES)
+					g_full++;
+			}
+			g_last = s->id;
+			start = t;
+			running = 1;
+		}
+		last = t;
+	}
+	return NULL;
+}
+
+int cmp(const void* a, const void* b)
+{
+	double x = *(const double*) a, y = *(const double*) b;
+
+	return (x > y) - (x < y);
+}
+
+/* the median slice, leaving out the first, which may have started part
+   way into a quantum */
+double median(slices_t* s)
+{
+	qsort(s->slices + 1, SLICES - 1, sizeof(double), cmp);
+	return s->slices[1 + (SLICES - 1) / 2];
+}
+
+int main()
+{
+	gtthread_t th1, th2;
+	slices_t batch = {1}, normal = {2};
+
+	gtthread_init(1000);
+	if (gtthread_set_quantum(12345, 1000) != -1 || gtthread_set_quantum(gtthread_self(), -1) != -1)
+		fprintf(stderr, "!ERROR! Bad quantum accepted\n");
+
+	gtthread_create(&th1, spinner, &batch);
+	gtthread_create(&th2, spinner, &normal);
+	gtthread_set_quantum(th1, 40000);
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+
+	if (median(&batch) < 2 * median(&normal))
+		fprintf(stderr, "!ERROR! Slices of %.1fms with a 40ms quantum, %.1fms without\n",
+		        median(&batch) * 1000, median(&normal) * 1000);
+	if (gtthread_get_quantum() != 1000)
+		fprintf(stderr, "!ERROR! Default quantum changed\n");
+
+	printf("done\n");
+	return 0;
+}
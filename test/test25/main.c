@@ -0,0 +1,122 @@
+// Test25
+// Preemption monitor. With the monitor on, threads that yield must not
+// be preempted at all, while a thread that never yields must still be
+// preempted so the others get to run. No timer may run under the monitor,
+// even for a thread with its own quantum.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <gtthread.h>
+
+volatile int g_stop = 0;
+volatile int g_rounds = 0;
+
+void* yielder(void* arg)
+{
+	int i;
+
+	for(i = 0; i < 1000; i++)
+	{
+		volatile long j;
+		for(j = 0; j < 10000; j++);
+		gtthread_yield();
+	}
+	return NULL;
+}
+
+void* hog(void* arg)
+{
+	while(!g_stop);
+	return NULL;
+}
+
+void* counter(void* arg)
+{
+	while(g_rounds < 5)
+	{
+		g_rounds++;
+		gtthread_yield();
+	}
+	g_stop = 1;
+	return NULL;
+}
+
+/* a thread with its own quantum, dispatched again after setting it */
+void* timed(void* arg)
+{
+	struct itimerval* timer = (struct itimerval*) arg;
+
+	gtthread_set_quantum(gtthread_self(), 500);
+	gtthread_yield();
+	getitimer(ITIMER_VIRTUAL, timer);
+	return NULL;
+}
+
+/* the preemptions_total counter of the metrics */
+unsigned long preemptions(void)
+{
+	char buf[8192];
+	char* line;
+	unsigned long n = 0;
+	int fds[2];
+	ssize_t len;
+
+	if (pipe(fds) != 0 || gtthread_metrics_write(fds[1]) != 0)
+		return 0;
+	close(fds[1]);
+	len = read(fds[0], buf, sizeof(buf) - 1);
+	close(fds[0]);
+	buf[len > 0 ? len : 0] = '\0';
+	if ((line = strstr(buf, "\ngtthread_preemptions_total ")) != NULL)
+		sscanf(line + 28, "%lu", &n);
+	return n;
+}
+
+int main()
+{
+	gtthread_t th1, th2;
+	unsigned long before;
+	struct itimerval timer;
+
+	gtthread_init(1000);
+	if (gtthread_monitor_start(0) != -1)
+		fprintf(stderr, "!ERROR! Monitor started without a limit\n");
+	if (gtthread_monitor_start(2000) != 0)
+	{
+		fprintf(stderr, "!ERROR! Cannot start the monitor\n");
+		return 1;
+	}
+
+	if (gtthread_prof_start(0, 0) != -1)
+		fprintf(stderr, "!ERROR! Profiler started on a tick that does not exist\n");
+
+	/* cooperative: no ticks */
+	before = preemptions();
+	gtthread_create(&th1, yielder, NULL);
+	gtthread_create(&th2, yielder, NULL);
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+	if (preemptions() != before)
+		fprintf(stderr, "!ERROR! Yielding threads were preempted\n");
+
+	/* the hog only stops once the counter has had five turns */
+	gtthread_create(&th1, hog, NULL);
+	gtthread_create(&th2, counter, NULL);
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+	if (preemptions() == before)
+		fprintf(stderr, "!ERROR! The hog was not preempted\n");
+
+	gtthread_create(&th1, timed, &timer);
+	gtthread_join(th1, NULL);
+	if (timer.it_interval.tv_sec != 0 || timer.it_interval.tv_usec != 0)
+		fprintf(stderr, "!ERROR! Own quantum armed under the monitor\n");
+
+	gtthread_monitor_stop();
+	if (gtthread_get_quantum() != 1000)
+		fprintf(stderr, "!ERROR! Timer not restored\n");
+	printf("done\n");
+	return 0;
+}
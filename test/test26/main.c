@@ -0,0 +1,80 @@
+// Test26
+// Cooperative mode. With a period of 0 no SIGVTALRM handler may be
+// installed while threads yield and hand over mutexes, and giving one
+// thread a quantum must still get it preempted, unless the library is
+// built without preemption altogether.
+
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <gtthread.h>
+
+#define THREADS 4
+#define ROUNDS 1000
+
+gtthread_mutex_t g_mutex;
+long g_counter;
+volatile int g_stop;
+
+void* worker(void* arg)
+{
+	int i;
+
+	for (i = 0; i < ROUNDS; i++)
+	{
+		gtthread_mutex_lock(&g_mutex);
+		g_counter++;
+		gtthread_yield();
+		gtthread_mutex_unlock(&g_mutex);
+	}
+	return NULL;
+}
+
+void* hog(void* arg)
+{
+	while (!g_stop);
+	return NULL;
+}
+
+int handler_installed(void)
+{
+	struct sigaction act;
+
+	sigaction(SIGVTALRM, NULL, &act);
+	return act.sa_handler != SIG_DFL;
+}
+
+int main()
+{
+	gtthread_t th[THREADS];
+	int i;
+
+	gtthread_init(0);
+	gtthread_mutex_init(&g_mutex);
+	for (i = 0; i < THREADS; i++)
+		gtthread_create(&th[i], worker, NULL);
+	for (i = 0; i < THREADS; i++)
+		gtthread_join(th[i], NULL);
+	if (g_counter != THREADS * ROUNDS)
+		fprintf(stderr, "!ERROR! Counter %ld, expected %d\n", g_counter, THREADS * ROUNDS);
+	if (handler_installed())
+		fprintf(stderr, "!ERROR! Handler installed in cooperative mode\n");
+
+	/* the hog only gives the processor back if it is preempted */
+	gtthread_create(&th[0], hog, NULL);
+	if (gtthread_set_quantum(th[0], 1000) != 0)
+	{
+		if (errno != ENOSYS)
+			fprintf(stderr, "!ERROR! Cannot set a quantum\n");
+		g_stop = 1;
+	}
+	else if (!handler_installed())
+		fprintf(stderr, "!ERROR! No handler for the quantum\n");
+	gtthread_yield();
+	g_stop = 1;
+	gtthread_join(th[0], NULL);
+
+	gtthread_mutex_destroy(&g_mutex);
+	printf("done\n");
+	return 0;
+}
@@ -0,0 +1,61 @@
+// Test27
+// Safepoints. In a cooperative program with the monitor on, a loop that
+// calls gtthread_check_preempt must give the processor up to the other
+// threads, without any signal being involved.
+
+#include <stdio.h>
+#include <signal.h>
+#include <gtthread.h>
+
+volatile int g_stop = 0;
+volatile int g_rounds = 0;
+volatile long g_checks = 0;
+
+void* looper(void* arg)
+{
+	while(!g_stop)
+	{
+		g_checks++;
+		gtthread_check_preempt();
+	}
+	return NULL;
+}
+
+void* counter(void* arg)
+{
+	while(g_rounds < 5)
+	{
+		g_rounds++;
+		gtthread_yield();
+	}
+	g_stop = 1;
+	return NULL;
+}
+
+int main()
+{
+	gtthread_t th1, th2;
+	struct sigaction act;
+
+	gtthread_init(0);
+	if (gtthread_monitor_start(2000) != 0)
+	{
+		fprintf(stderr, "!ERROR! Cannot start the monitor\n");
+		return 1;
+	}
+
+	/* the looper only stops once the counter has had five turns */
+	gtthread_create(&th1, looper, NULL);
+	gtthread_create(&th2, counter, NULL);
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+	gtthread_monitor_stop();
+
+	if (g_checks == 0)
+		fprintf(stderr, "!ERROR! The looper never ran\n");
+	sigaction(SIGVTALRM, NULL, &act);
+	if (act.sa_handler != SIG_DFL)
+		fprintf(stderr, "!ERROR! The monitor installed a signal handler\n");
+	printf("done\n");
+	return 0;
+}
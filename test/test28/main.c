@@ -0,0 +1,64 @@
+// Test28
+// FP control across switches. Threads with different rounding modes
+// yield to each other and get preempted; each must keep its own mode,
+// and floating-point values live across a switch must survive it.
+
+#include <stdio.h>
+#include <fenv.h>
+#include <gtthread.h>
+
+#define ROUNDS 2000
+
+int g_modes[] = {FE_TONEAREST, FE_UPWARD, FE_DOWNWARD, FE_TOWARDZERO};
+volatile double g_one = 1, g_three = 3;
+
+void* worker(void* arg)
+{
+	int mode = *(int*) arg;
+	volatile double x;
+	double third, sum = 0;
+	int i;
+	long j;
+
+	/* fegetround reads the x87 unit; the division checks the SSE one */
+	fesetround(mode);
+	third = g_one / g_three;
+	for (i = 0; i < ROUNDS; i++)
+	{
+		x = g_one / g_three;
+		sum += x;
+		if (i % 2 == 0)
+			gtthread_yield();
+		else
+			for (j = 0; j < 2000; j++);
+		if (x != third)
+		{
+			fprintf(stderr, "!ERROR! Division rounded differently in mode %d\n", mode);
+			break;
+		}
+		if (fegetround() != mode)
+		{
+			fprintf(stderr, "!ERROR! Rounding mode %d became %d\n", mode, fegetround());
+			break;
+		}
+	}
+	if (sum < ROUNDS / 3.0 - 1 || sum > ROUNDS / 3.0 + 1)
+		fprintf(stderr, "!ERROR! Sum %f\n", sum);
+	return NULL;
+}
+
+int main()
+{
+	gtthread_t th[4];
+	int i;
+
+	gtthread_init(100);
+	for (i = 0; i < 4; i++)
+		gtthread_create(&th[i], worker, &g_modes[i]);
+	for (i = 0; i < 4; i++)
+		gtthread_join(th[i], NULL);
+	if (fegetround() != FE_TONEAREST)
+		fprintf(stderr, "!ERROR! Main thread's rounding mode changed\n");
+	printf("done\n");
+	return 0;
+}
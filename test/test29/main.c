@@ -0,0 +1,97 @@
+// Test29
+// Handoff without starvation. Two threads pass a lock back and forth,
+// each woken thread running next, in a cooperative program where no
+// tick ends their chain; a third thread must still get its turns. A
+// thread joining one that exits must also run next, ahead of the queue.
+
+#include <stdio.h>
+#include <gtthread.h>
+
+gtthread_mutex_t g_mutex;
+volatile int g_stop = 0;
+long g_handoffs = 0;
+volatile long g_turns = 0;
+long g_turns_at_exit = -1;
+
+void* passer(void* arg)
+{
+	int first = 1;
+
+	while (!g_stop)
+	{
+		gtthread_mutex_lock(&g_mutex);
+		g_handoffs++;
+		/* once, so that the other passer queues for the lock */
+		if (first)
+		{
+			first = 0;
+			gtthread_yield();
+		}
+		gtthread_mutex_unlock(&g_mutex);
+	}
+	return NULL;
+}
+
+void* other(void* arg)
+{
+	int i;
+
+	for (i = 0; i < 100; i++)
+		gtthread_yield();
+	g_stop = 1;
+	return NULL;
+}
+
+void* yielder(void* arg)
+{
+	while (!g_stop)
+	{
+		g_turns++;
+		gtthread_yield();
+	}
+	return NULL;
+}
+
+void* finisher(void* arg)
+{
+	int i;
+
+	for (i = 0; i < 10; i++)
+		gtthread_yield();
+	g_turns_at_exit = g_turns;
+	return NULL;
+}
+
+int main()
+{
+	gtthread_t th1, th2, th3, th4;
+
+	gtthread_init(0);
+	gtthread_mutex_init(&g_mutex);
+	gtthread_create(&th1, passer, NULL);
+	gtthread_create(&th2, passer, NULL);
+	gtthread_create(&th3, other, NULL);
+	gtthread_join(th3, NULL);
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+
+	if (g_handoffs < 10)
+		fprintf(stderr, "!ERROR! Only %ld handoffs\n", g_handoffs);
+
+	g_stop = 0;
+	gtthread_create(&th1, yielder, NULL);
+	gtthread_create(&th2, yielder, NULL);
+	gtthread_create(&th3, finisher, NULL);
+	gtthread_create(&th4, yielder, NULL);
+	gtthread_join(th3, NULL);
+	if (g_turns != g_turns_at_exit)
+		fprintf(stderr, "!ERROR! %ld turns between the exit and the joiner\n",
+		        g_turns - g_turns_at_exit);
+	g_stop = 1;
+	gtthread_join(th1, NULL);
+	gtthread_join(th2, NULL);
+	gtthread_join(th4, NULL);
+	gtthread_mutex_destroy(&g_mutex);
+	printf("done\n");
+	return 0;
+}
@@ -0,0 +1,50 @@
+// Test30
+// Directed yield. gtthread_yield_to must run the thread asked for ahead
+// of those queued before it, even one that has not run yet, leave the
+// rest of the queue in order, and refuse threads that do not exist or
+// have terminated.
+
+#include <stdio.h>
+#include <errno.h>
+#include <gtthread.h>
+
+#define THREADS 4
+
+char g_order[THREADS + 1];
+int g_ran;
+
+void* worker(void* arg)
+{
+	g_order[g_ran++] = '0' + (int) (long) arg;
+	return NULL;
+}
+
+int main()
+{
+	gtthread_t th[THREADS];
+	long i;
+
+	gtthread_init(0);
+	for (i = 0; i < THREADS; i++)
+		gtthread_create(&th[i], worker, (void*) i);
+
+	if (gtthread_yield_to(gtthread_self()) != 0 || g_ran != 0)
+		fprintf(stderr, "!ERROR! Yielding to oneself switched\n");
+	if (gtthread_yield_to(th[2]) != 0 || g_order[0] != '2')
+		fprintf(stderr, "!ERROR! Thread 2 did not run first\n");
+
+	for (i = 0; i < THREADS; i++)
+		gtthread_join(th[i], NULL);
+	if (g_order[1] != '0' || g_order[2] != '1' || g_order[3] != '3')
+		fprintf(stderr, "!ERROR! Queue order %s, expected 2013\n", g_order);
+
+	errno = 0;
+	if (gtthread_yield_to(th[1]) != -1 || errno != ESRCH)
+		fprintf(stderr, "!ERROR! Yielded to a terminated thread\n");
+	errno = 0;
+	if (gtthread_yield_to(th[THREADS - 1] + 100) != -1 || errno != ESRCH)
+		fprintf(stderr, "!ERROR! Yielded to a thread never created\n");
+
+	printf("done\n");
+	return 0;
+}
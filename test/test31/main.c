@@ -0,0 +1,65 @@
+// Test31
+// Starvation. Two threads hand the processor to each other with
+// gtthread_yield_to in a cooperative program, so nothing but aging ever
+// lets the rest of the ready queue run; a batch thread must still
+// finish, and the scheduler must count the boosts it got.
+
+#include <stdio.h>
+#include <gtthread.h>
+
+#define BATCH_ROUNDS 100
+
+gtthread_t g_ping, g_pong;
+volatile int g_stop = 0;
+long g_handoffs = 0;
+
+void* ping(void* arg)
+{
+	while (!g_stop)
+	{
+		g_handoffs++;
+		gtthread_yield_to(g_pong);
+	}
+	return NULL;
+}
+
+void* pong(void* arg)
+{
+	while (!g_stop)
+	{
+		g_handoffs++;
+		gtthread_yield_to(g_ping);
+	}
+	return NULL;
+}
+
+void* batch(void* arg)
+{
+	int i;
+
+	for (i = 0; i < BATCH_ROUNDS; i++)
+		gtthread_yield();
+	g_stop = 1;
+	return NULL;
+}
+
+int main()
+{
+	gtthread_t th;
+
+	gtthread_init(0);
+	gtthread_create(&g_ping, ping, NULL);
+	gtthread_create(&g_pong, pong, NULL);
+	gtthread_create(&th, batch, NULL);
+	gtthread_join(th, NULL);
+	gtthread_join(g_ping, NULL);
+	gtthread_join(g_pong, NULL);
+
+	if (gtthread_starvations() < BATCH_ROUNDS)
+		fprintf(stderr, "!ERROR! %lu starvations for %d batch rounds\n",
+		        gtthread_starvations(), BATCH_ROUNDS);
+	if (g_handoffs < BATCH_ROUNDS)
+		fprintf(stderr, "!ERROR! Only %ld handoffs\n", g_handoffs);
+	printf("done\n");
+	return 0;
+}
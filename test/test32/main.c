@@ -0,0 +1,110 @@
+// Test32
+// Thread groups. A group of 2 threads at weight 300 must get about three
+// times the CPU of a group of 50 threads at weight 100, where round robin
+// would give it 4%; a group capped at 20% must sleep through the rest of
+// the time even with nothing else to run. Only existing groups can be
+// destroyed.
+
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <gtthread.h>
+
+#define MANY 50
+#define FEW 2
+#define RUN_NS 300000000LL
+
+volatile int g_stop = 0;
+long g_work[2];
+
+long long now_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void spin(long long ns)
+{
+	long long end = now_ns(CLOCK_MONOTONIC) + ns;
+
+	while (now_ns(CLOCK_MONOTONIC) < end);
+}
+
+void* worker(void* arg)
+{
+	long i = (long) arg;
+
+	while (!g_stop)
+	{
+		spin(20000);
+		g_work[i]++;
+		gtthread_yield();
+	}
+	return NULL;
+}
+
+int main()
+{
+	gtthread_group_t many, few, capped;
+	gtthread_t th[MANY + FEW];
+	long long start, cpu;
+	double share;
+	int i;
+
+	gtthread_init(0);
+	if (gtthread_group_create(&many, 0, 0) != -1 || errno != EINVAL)
+		fprintf(stderr, "!ERROR! Created a group of weight 0\n");
+	gtthread_group_create(&many, 100, 0);
+	gtthread_group_create(&few, 300, 0);
+
+	/* threads start in their creator's group */
+	gtthread_group_attach(many, gtthread_self());
+	for (i = 0; i < MANY; i++)
+		gtthread_create(&th[i], worker, (void*) 0);
+	gtthread_group_attach(few, gtthread_self());
+	for (i = MANY; i < MANY + FEW; i++)
+		gtthread_create(&th[i], worker, (void*) 1);
+	gtthread_group_attach(NULL, gtthread_self());
+
+	start = now_ns(CLOCK_MONOTONIC);
+	while (now_ns(CLOCK_MONOTONIC) - start < RUN_NS)
+		gtthread_yield();
+	g_stop = 1;
+	share = (double) g_work[1] / (g_work[0] + g_work[1]);
+	if (share < 0.6 || share > 0.9)
+		fprintf(stderr, "!ERROR! Weight 300 group got %.0f%% of the work, "
+		        "expected 75%%\n", share * 100);
+
+	if (gtthread_group_destroy(few) != -1 || errno != EBUSY)
+		fprintf(stderr, "!ERROR! Destroyed a group with threads\n");
+	for (i = 0; i < MANY + FEW; i++)
+		gtthread_join(th[i], NULL);
+	if (gtthread_group_destroy(many) != 0 || gtthread_group_destroy(few) != 0)
+		fprintf(stderr, "!ERROR! Cannot destroy empty groups\n");
+	if (gtthread_group_destroy(few) != -1 || errno != EINVAL
+	    || gtthread_group_destroy(NULL) != -1 || errno != EINVAL)
+		fprintf(stderr, "!ERROR! Destroyed a group that does not exist\n");
+
+	/* alone and capped, the main thread must idle */
+	gtthread_group_create(&capped, 100, 20);
+	gtthread_group_attach(capped, gtthread_self());
+	start = now_ns(CLOCK_MONOTONIC);
+	cpu = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+	while (now_ns(CLOCK_MONOTONIC) - start < RUN_NS)
+	{
+		spin(50000);
+		gtthread_yield();
+	}
+	share = (double) (now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu)
+	        / (now_ns(CLOCK_MONOTONIC) - start);
+	if (share < 0.1 || share > 0.35)
+		fprintf(stderr, "!ERROR! Group capped at 20%% used %.0f%% of the CPU\n",
+		        share * 100);
+	gtthread_group_attach(NULL, gtthread_self());
+	gtthread_group_destroy(capped);
+
+	printf("done\n");
+	return 0;
+}
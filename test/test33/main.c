@@ -0,0 +1,140 @@
+// Test33
+// CPU budgets. A thread limited to 20% of the CPU must get about a fifth
+// of it while the main thread competes for the rest, and must leave the
+// process idle for the rest of the time once it runs alone, with the main
+// thread joining it. While parked over its budget, the metrics must count
+// it as throttled and leave it out of the run queue.
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <gtthread.h>
+
+#define RUN_NS 300000000LL
+
+volatile int g_stop = 0;
+long g_work;
+
+long long now_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void spin(long long ns)
+{
+	long long end = now_ns(CLOCK_MONOTONIC) + ns;
+
+	while (now_ns(CLOCK_MONOTONIC) < end);
+}
+
+void* compactor(void* arg)
+{
+	long long until = (long long) arg;
+
+	while (!g_stop && (until == 0 || now_ns(CLOCK_MONOTONIC) < until))
+	{
+		spin(50000);
+		g_work++;
+		gtthread_yield();
+	}
+	return NULL;
+}
+
+/* the metrics say the compactor is parked, and nothing else is ready */
+int throttled(void)
+{
+	char buf[8192];
+	int fds[2];
+	ssize_t len;
+
+	if (pipe(fds) != 0 || gtthread_metrics_write(fds[1]) != 0)
+		return 0;
+	close(fds[1]);
+	len = read(fds[0], buf, sizeof(buf) - 1);
+	close(fds[0]);
+	buf[len > 0 ? len : 0] = '\0';
+	return strstr(buf, "gtthread_threads{state=\"throttled\"} 1\n") != NULL
+	       && strstr(buf, "\ngtthread_run_queue_length 0\n") != NULL;
+}
+
+int main()
+{
+	gtthread_t th;
+	long long start, cpu;
+	long mine = 0;
+	double share;
+
+	gtthread_init(0);
+	if (gtthread_set_cpu_budget(gtthread_self(), -1) != -1 || errno != EINVAL
+	    || gtthread_set_cpu_budget(gtthread_self(), GTTHREAD_BUDGET_PERIOD + 1) != -1
+	    || errno != EINVAL)
+		fprintf(stderr, "!ERROR! Set a budget out of range\n");
+	if (gtthread_set_cpu_budget(12345, 0) != -1 || errno != ESRCH)
+		fprintf(stderr, "!ERROR! Set the budget of no thread\n");
+
+	/* against the main thread */
+	gtthread_create(&th, compactor, (void*) 0);
+	gtthread_set_cpu_budget(th, GTTHREAD_BUDGET_PERIOD / 5);
+	start = now_ns(CLOCK_MONOTONIC);
+	while (now_ns(CLOCK_MONOTONIC) - start < RUN_NS)
+	{
+		spin(50000);
+		mine++;
+		gtthread_yield();
+	}
+	g_stop = 1;
+	gtthread_join(th, NULL);
+	share = (double) g_work / (g_work + mine);
+	if (share < 0.1 || share > 0.35)
+		fprintf(stderr, "!ERROR! Thread with a 20%% budget got %.0f%% of the "
+		        "CPU\n", share * 100);
+
+	/* alone, while the main thread waits for it */
+	g_stop = 0;
+	start = now_ns(CLOCK_MONOTONIC);
+	cpu = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+	gtthread_create(&th, compactor, (void*) (start + RUN_NS));
+	gtthread_set_cpu_budget(th, GTTHREAD_BUDGET_PERIOD / 5);
+	gtthread_join(th, NULL);
+	share = (double) (now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu)
+	        / (now_ns(CLOCK_MONOTONIC) - start);
+	if (share < 0.1 || share > 0.35)
+		fprintf(stderr, "!ERROR! Thread with a 20%% budget alone used %.0f%% of "
+		        "the CPU\n", share * 100);
+
+	/* parked over a 1% budget, and then a budget of 0 lifts the limit */
+	g_stop = 0;
+	g_work = 0;
+	gtthread_create(&th, compactor, (void*) 0);
+	gtthread_set_cpu_budget(th, GTTHREAD_BUDGET_PERIOD / 100);
+	start = now_ns(CLOCK_MONOTONIC);
+	while (!throttled() && now_ns(CLOCK_MONOTONIC) - start < RUN_NS)
+	{
+		spin(50000);
+		gtthread_yield();
+	}
+	if (now_ns(CLOCK_MONOTONIC) - start >= RUN_NS)
+		fprintf(stderr, "!ERROR! Parked thread not reported as throttled\n");
+	gtthread_set_cpu_budget(th, 0);
+	g_work = 0;
+	start = now_ns(CLOCK_MONOTONIC);
+	mine = 0;
+	while (now_ns(CLOCK_MONOTONIC) - start < RUN_NS / 3)
+	{
+		spin(50000);
+		mine++;
+		gtthread_yield();
+	}
+	g_stop = 1;
+	gtthread_join(th, NULL);
+	if (g_work < mine / 2)
+		fprintf(stderr, "!ERROR! Lifted budget still limits the thread\n");
+
+	printf("done\n");
+	return 0;
+}
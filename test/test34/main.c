@@ -0,0 +1,126 @@
+// Test34
+// Deterministic scheduling. Three threads take a mutex in turn and race
+// on a counter between safepoints, with a timer that would preempt them
+// at random points. Runs in child processes with the same seed must
+// interleave alike, and so must a replay of the recording of the first,
+// while another seed must interleave differently.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <gtthread.h>
+
+#define RECORD_PATH "/tmp/gtthread_test34.schedule"
+#define THREADS 3
+#define ROUNDS 100
+#define OUT 512
+
+gtthread_mutex_t g_mutex;
+char g_order[THREADS * ROUNDS + 1];
+int g_n;
+volatile long g_racy;
+
+void spin(long ns)
+{
+	struct timespec t0, t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	do
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+	while ((t1.tv_sec - t0.tv_sec) * 1000000000L + t1.tv_nsec - t0.tv_nsec < ns);
+}
+
+void* worker(void* arg)
+{
+	long id = (long) arg;
+	long v;
+	int i;
+
+	for (i = 0; i < ROUNDS; i++)
+	{
+		gtthread_mutex_lock(&g_mutex);
+		g_order[g_n++] = '0' + id;
+		gtthread_mutex_unlock(&g_mutex);
+
+		/* a lost update, if a switch comes in between */
+		v = g_racy;
+		spin(20000);
+		gtthread_check_preempt();
+		g_racy = v + 1;
+		gtthread_check_preempt();
+	}
+	return NULL;
+}
+
+/* runs the threads in a child, seeded, or replaying if seed is 0, and
+ * reads back the order they took the mutex in and the racy count */
+void run(unsigned long seed, const char* record, char* out)
+{
+	gtthread_t th[THREADS];
+	int fd[2];
+	long i;
+	ssize_t n;
+
+	pipe(fd);
+	if (fork() == 0)
+	{
+		close(fd[0]);
+		gtthread_init(1000);
+		if (seed != 0)
+			gtthread_deterministic_start(seed, 5, record);
+		else if (gtthread_replay_start(RECORD_PATH) < 0)
+			perror("gtthread_replay_start");
+		gtthread_mutex_init(&g_mutex);
+		for (i = 0; i < THREADS; i++)
+			gtthread_create(&th[i], worker, (void*) i);
+		for (i = 0; i < THREADS; i++)
+			gtthread_join(th[i], NULL);
+		dprintf(fd[1], "%s %ld", g_order, g_racy);
+		_exit(0);
+	}
+	close(fd[1]);
+	n = read(fd[0], out, OUT - 1);
+	out[n > 0 ? n : 0] = '\0';
+	close(fd[0]);
+	wait(NULL);
+}
+
+int main()
+{
+	char recorded[OUT], seeded[OUT], replayed[OUT], other[OUT];
+	char line[64];
+	int preempts = 0;
+	FILE* f;
+
+	run(42, RECORD_PATH, recorded);
+	run(42, NULL, seeded);
+	run(0, NULL, replayed);
+	run(7, NULL, other);
+
+	if (strlen(recorded) < THREADS * ROUNDS)
+		fprintf(stderr, "!ERROR! Seeded run did not finish: %s\n", recorded);
+	if (strcmp(recorded, seeded) != 0)
+		fprintf(stderr, "!ERROR! Runs with the same seed differ\n");
+	if (strcmp(recorded, replayed) != 0)
+		fprintf(stderr, "!ERROR! Replay differs from the recording\n");
+	if (strcmp(recorded, other) == 0)
+		fprintf(stderr, "!ERROR! Runs with different seeds are alike\n");
+
+	if ((f = fopen(RECORD_PATH, "r")) == NULL)
+		fprintf(stderr, "!ERROR! No recording\n");
+	else
+	{
+		while (fgets(line, sizeof(line), f) != NULL)
+			if (strstr(line, " p\n") != NULL)
+				preempts++;
+		fclose(f);
+		if (preempts == 0)
+			fprintf(stderr, "!ERROR! No preemption recorded\n");
+	}
+	unlink(RECORD_PATH);
+
+	printf("done\n");
+	return 0;
+}
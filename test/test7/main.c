@@ -1,12 +1,14 @@
 // Test7
-// gtthread_cancel. The program should terminate smoothly.
+// gtthread_cancel. The program should terminate smoothly. The spinning
+// threads are only cancelled at a cancellation point.
 
 #include <stdio.h>
 #include <gtthread.h>
 
 void* worker2(void* arg)
 {
-	while(1);
+	while(1)
+		gtthread_testcancel();
 }
 
 void* worker(void* arg)
@@ -17,7 +19,8 @@ void* worker(void* arg)
 	gtthread_cancel(th);
 	gtthread_join(th, NULL);
 
-	while(1);
+	while(1)
+		gtthread_testcancel();
 }
 
 int main()
@@ -0,0 +1,202 @@
+// trace2json
+// Converts a trace file written by gtthread_trace_start into the Chrome
+// trace event format, which chrome://tracing and ui.perfetto.dev open.
+// Every gtthread gets a track showing when it ran and how long it waited
+// for locks and joins; preemptions, yields, creation, exit and lock
+// handoffs are instant events on the track of the thread they hit.
+//
+//	trace2json trace.bin > trace.json
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gtthread_trace.h>
+
+// per-thread state while walking the events
+typedef struct {
+	double wait_start;	// start of a lock or join wait, < 0 if none
+	uint64_t wait_arg;
+	int named;
+} track_t;
+
+static track_t* g_tracks;
+static uint64_t g_ntracks;
+static double g_ticks_per_us;
+static uint64_t g_start;
+static int g_first = 1;
+
+static double ts(uint64_t time)
+{
+	return (double) (time - g_start) / g_ticks_per_us;
+}
+
+static void emit(const char* fmt, ...)
+{
+	va_list ap;
+
+	printf(g_first ? "\n" : ",\n");
+	g_first = 0;
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+static track_t* track(uint32_t tid)
+{
+	uint64_t i;
+
+	if (tid >= g_ntracks) {
+		g_tracks = realloc(g_tracks, (tid + 1) * sizeof(track_t));
+		for (i = g_ntracks; i <= tid; i++) {
+			g_tracks[i].wait_start = -1;
+			g_tracks[i].named = 0;
+		}
+		g_ntracks = tid + 1;
+	}
+	if (!g_tracks[tid].named) {
+		g_tracks[tid].named = 1;
+		emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+		     "\"args\":{\"name\":\"gtthread %u\"}}", tid, tid);
+	}
+	return &g_tracks[tid];
+}
+
+static void slice(const char* name, uint32_t tid, double from, double to,
+                  const char* args)
+{
+	emit("{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+	     "\"ts\":%.3f,\"dur\":%.3f%s}", name, tid, from, to - from, args);
+}
+
+static void instant(const char* name, uint32_t tid, double at, const char* args)
+{
+	emit("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,"
+	     "\"ts\":%.3f%s}", name, tid, at, args);
+}
+
+int main(int argc, char** argv)
+{
+	gtthread_trace_header_t header;
+	gtthread_trace_event_t* events;
+	gtthread_trace_event_t* e;
+	uint64_t first, n, i;
+	uint32_t running = 0;
+	double run_start = 0, at = 0;
+	char args[96];
+	track_t* t;
+	FILE* f;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s trace-file\n", argv[0]);
+		return 2;
+	}
+	f = fopen(argv[1], "rb");
+	if (f == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	if (fread(&header, sizeof(header), 1, f) != 1
+	    || memcmp(header.magic, GTTHREAD_TRACE_MAGIC, 8) != 0
+	    || header.event_size != sizeof(gtthread_trace_event_t)
+	    || header.capacity == 0) {
+		fprintf(stderr, "%s: not a gtthread trace\n", argv[1]);
+		return 1;
+	}
+
+	// the ring holds the last 'capacity' events of the run
+	n = header.head < header.capacity ? header.head : header.capacity;
+	first = header.head - n;
+	events = malloc(header.capacity * sizeof(gtthread_trace_event_t));
+	if (events == NULL
+	    || fread(events, sizeof(gtthread_trace_event_t), header.capacity, f)
+	       != header.capacity) {
+		fprintf(stderr, "%s: truncated trace\n", argv[1]);
+		return 1;
+	}
+	fclose(f);
+
+	g_ticks_per_us = header.ticks_per_us;
+	g_start = header.start;
+
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	for (i = first; i < header.head; i++) {
+		e = &events[i & (header.capacity - 1)];
+		at = ts(e->time);
+		t = track(e->tid);
+
+		// whoever the first event happened on was running
+		if (running == 0) {
+			running = e->tid;
+			run_start = at;
+		}
+
+		switch (e->type) {
+		case GTTHREAD_TRACE_SWITCH:
+			slice("running", e->tid, run_start, at, "");
+			track((uint32_t) e->arg);
+			running = (uint32_t) e->arg;
+			run_start = at;
+			break;
+		case GTTHREAD_TRACE_PREEMPT:
+			instant("preempt", e->tid, at, "");
+			break;
+		case GTTHREAD_TRACE_YIELD:
+			args[0] = '\0';
+			if (e->arg != 0)
+				snprintf(args, sizeof(args), ",\"args\":{\"thread\":%lu}",
+				         (unsigned long) e->arg);
+			instant("yield", e->tid, at, args);
+			break;
+		case GTTHREAD_TRACE_CREATE:
+			snprintf(args, sizeof(args), ",\"args\":{\"thread\":%lu}",
+			         (unsigned long) e->arg);
+			instant("create", e->tid, at, args);
+			track((uint32_t) e->arg);
+			break;
+		case GTTHREAD_TRACE_EXIT:
+			instant(e->arg == 1 ? "cancelled" : "exit", e->tid, at, "");
+			break;
+		case GTTHREAD_TRACE_LOCK_WAIT:
+		case GTTHREAD_TRACE_JOIN_WAIT:
+			t->wait_start = at;
+			t->wait_arg = e->arg;
+			break;
+		case GTTHREAD_TRACE_LOCK:
+			if (t->wait_start >= 0) {
+				snprintf(args, sizeof(args),
+				         ",\"args\":{\"mutex\":\"0x%lx\"}",
+				         (unsigned long) t->wait_arg);
+				slice("lock wait", e->tid, t->wait_start, at, args);
+				t->wait_start = -1;
+			}
+			break;
+		case GTTHREAD_TRACE_JOIN:
+			if (t->wait_start >= 0) {
+				snprintf(args, sizeof(args),
+				         ",\"args\":{\"thread\":%lu}",
+				         (unsigned long) t->wait_arg);
+				slice("join wait", e->tid, t->wait_start, at, args);
+				t->wait_start = -1;
+			}
+			break;
+		case GTTHREAD_TRACE_UNLOCK:
+			snprintf(args, sizeof(args), ",\"args\":{\"mutex\":\"0x%lx\"}",
+			         (unsigned long) e->arg);
+			instant("unlock", e->tid, at, args);
+			break;
+		case GTTHREAD_TRACE_WAKEUP:
+			snprintf(args, sizeof(args), ",\"args\":{\"thread\":%lu}",
+			         (unsigned long) e->arg);
+			instant("handoff", e->tid, at, args);
+			break;
+		}
+	}
+	if (running != 0)
+		slice("running", running, run_start, at, "");
+	printf("\n]}\n");
+
+	free(events);
+	free(g_tracks);
+	return 0;
+}